@@ -0,0 +1,218 @@
+//  Adpcm.cpp :: Block-compressed IMA ADPCM audio storage
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "Adpcm.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include "Sample.hpp"
+
+namespace awe {
+
+namespace {
+
+//! IMA ADPCM quantizer step sizes.
+int const sStepTable[89] = {
+        7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+       19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+       50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+      130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+      337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+      876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+     2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+     5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+//! IMA ADPCM step index adjustment for each code magnitude.
+int const sIndexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+//! Predictor state of one channel.
+struct State
+{
+    int predictor;
+    int index;
+
+    //! Applies a four bit code and returns the new predicted sample.
+    inline int decode(unsigned code)
+    {
+        int const step = sStepTable[index];
+
+        int diff = step >> 3;
+        if (code & 4) diff += step;
+        if (code & 2) diff += step >> 1;
+        if (code & 1) diff += step >> 2;
+
+        predictor += (code & 8) ? -diff : diff;
+        predictor  = std::min(std::max(predictor, -32768), 32767);
+
+        index += sIndexTable[code & 7];
+        index  = std::min(std::max(index, 0), 88);
+
+        return predictor;
+    }
+
+    //! \return the four bit code closest to `sample`, and applies it.
+    inline unsigned encode(int sample)
+    {
+        int      step = sStepTable[index];
+        int      diff = sample - predictor;
+        unsigned code = 0;
+
+        if (diff < 0) {
+            code = 8;
+            diff = -diff;
+        }
+
+        if (diff >= step) { code |= 4; diff -= step; }
+        step >>= 1;
+        if (diff >= step) { code |= 2; diff -= step; }
+        step >>= 1;
+        if (diff >= step) { code |= 1; }
+
+        // Track the decoder exactly, rounding included.
+        decode(code);
+        return code;
+    }
+};
+
+}
+
+AadpcmBuffer::AadpcmBuffer(const Aint* data, size_t frames, Achan channels, size_t block_frames)
+    : mBlocks     ()
+    , mFrames     (frames)
+    , mBlockFrames(std::max<size_t>(2, (block_frames + 1) & ~size_t(1)))
+    , mBlockBytes (0)
+    , mChannels   (channels)
+{
+    assert(channels >= 1 && channels <= MAX_CHANNELS);
+
+    size_t const runBytes = HEADER_BYTES + mBlockFrames / 2;
+    mBlockBytes = runBytes * channels;
+    mBlocks.assign(getBlockCount() * mBlockBytes, 0);
+
+    // The step index carries over from block to block, so that the
+    // encoder does not have to adapt again at every block. It starts
+    // from the first difference in each channel instead of the smallest
+    // step, which would smear a loud attack over dozens of samples.
+    State state[MAX_CHANNELS];
+    for (Achan c = 0; c < channels; c++) {
+        int const diff = frames > 1 ? std::abs(data[channels + c] - data[c]) : 0;
+        state[c].index = 0;
+        while (state[c].index < 88 && sStepTable[state[c].index] < diff)
+            state[c].index++;
+    }
+
+    for (size_t b = 0; b < getBlockCount(); b++)
+    {
+        size_t const first = b * mBlockFrames;
+        size_t const count = std::min(mBlockFrames, frames - first);
+
+        for (Achan c = 0; c < channels; c++)
+        {
+            uint8_t   * const run = mBlocks.data() + b * mBlockBytes + c * runBytes;
+            const Aint* const src = data + first * channels + c;
+
+            state[c].predictor = src[0];
+
+            run[0] = static_cast<uint8_t>(src[0] & 0xFF);
+            run[1] = static_cast<uint8_t>((src[0] >> 8) & 0xFF);
+            run[2] = static_cast<uint8_t>(state[c].index);
+            run[3] = 0;
+
+            // Pad a short last block with its last sample.
+            for (size_t i = 1; i < mBlockFrames; i++) {
+                Aint     const s    = src[std::min(i, count - 1) * channels];
+                unsigned const code = state[c].encode(s);
+                size_t   const j    = i - 1;
+
+                run[HEADER_BYTES + j / 2] |= static_cast<uint8_t>(code << ((j & 1) * 4));
+            }
+        }
+    }
+}
+
+size_t AadpcmBuffer::decode(size_t block, Aint* dst) const
+{
+    assert(block < getBlockCount());
+
+    size_t const runBytes = HEADER_BYTES + mBlockFrames / 2;
+    size_t const count    = std::min(mBlockFrames, mFrames - block * mBlockFrames);
+    Achan  const channels = mChannels;
+
+    const uint8_t* const base = mBlocks.data() + block * mBlockBytes;
+
+    State state[MAX_CHANNELS];
+
+    for (Achan c = 0; c < channels; c++) {
+        const uint8_t* const run = base + c * runBytes;
+        state[c].predictor = static_cast<int16_t>(run[0] | (run[1] << 8));
+        state[c].index     = std::min<int>(run[2], 88);
+        dst[c] = static_cast<Aint>(state[c].predictor);
+    }
+
+    // Each byte holds two frames of a channel. Channels are decoded side
+    // by side, as each one is a serial chain on its own.
+    for (size_t i = 1; i < count; i += 2)
+    {
+        size_t const byte = HEADER_BYTES + (i - 1) / 2;
+        Aint*  const out  = dst + i * channels;
+
+        for (Achan c = 0; c < channels; c++) {
+            unsigned const codes = base[c * runBytes + byte];
+            out[c] = static_cast<Aint>(state[c].decode(codes & 0xF));
+        }
+
+        if (i + 1 < count) {
+            for (Achan c = 0; c < channels; c++) {
+                unsigned const codes = base[c * runBytes + byte];
+                out[channels + c] = static_cast<Aint>(state[c].decode(codes >> 4));
+            }
+        }
+    }
+
+    return count;
+}
+
+void AadpcmReader::reset(const AadpcmBuffer* buffer)
+{
+    mBuffer = buffer;
+    mBlock  = NO_BLOCK;
+    mCached = 0;
+
+    if (buffer != nullptr && mCache.size() < buffer->getBlockFrames() * buffer->getChannelCount())
+        mCache.resize(buffer->getBlockFrames() * buffer->getChannelCount());
+}
+
+const Aint* AadpcmReader::fetch(size_t frame, size_t &frames)
+{
+    assert(mBuffer != nullptr && frame < mBuffer->getFrameCount());
+
+    size_t const block = frame / mBuffer->getBlockFrames();
+
+    if (block != mBlock) {
+        mCached = mBuffer->decode(block, mCache.data());
+        mBlock  = block;
+    }
+
+    size_t const offset = frame - block * mBuffer->getBlockFrames();
+    frames = std::min(frames, mCached - offset);
+
+    return mCache.data() + offset * mBuffer->getChannelCount();
+}
+
+// Asample compression
+bool Asample::compress(size_t block_frames)
+{
+    if (mFormat != Format::INT16 || mData == nullptr)
+        return false;
+
+    std::shared_ptr<const AadpcmBuffer> const compressed =
+        std::make_shared<AadpcmBuffer>(getData(), getFrameCount(), mChannels, block_frames);
+
+    setSource(compressed, mSourcePeak);
+    return true;
+}
+
+}
@@ -0,0 +1,119 @@
+//  Adpcm.hpp :: Block-compressed IMA ADPCM audio storage
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_ADPCM_H
+#define AWE_ADPCM_H
+
+#include <cstdint>
+#include <vector>
+#include "Define.hpp"
+
+namespace awe {
+
+/** Interleaved 16-bit audio compressed into IMA ADPCM blocks.
+ *
+ *  Each sample is stored in four bits, about a quarter of the size of
+ *  the same data in an \ref AiBuffer. The audio is cut into blocks of
+ *  \ref getBlockFrames() frames which carry their own decoder state, so
+ *  any block can be decoded on its own; see \ref AadpcmReader.
+ *
+ *  A block holds one run of bytes per channel, each made of a four byte
+ *  header (the first sample of the block and the initial step index)
+ *  followed by the remaining samples of that channel, two per byte, low
+ *  nibble first.
+ */
+class AadpcmBuffer
+{
+private:
+    std::vector<uint8_t> mBlocks;       //!< Encoded blocks, back to back
+    size_t               mFrames;       //!< Number of frames of audio
+    size_t               mBlockFrames;  //!< Number of frames per block
+    size_t               mBlockBytes;   //!< Size of an encoded block
+    Achan                mChannels;     //!< Number of interleaved channels
+
+public:
+    //! Default number of frames per block.
+    static constexpr size_t DEFAULT_BLOCK_FRAMES = 1024;
+
+    //! Size of the per-channel block header in bytes.
+    static constexpr size_t HEADER_BYTES = 4;
+
+    /** Encodes interleaved 16-bit audio.
+     *
+     *  \param data         interleaved audio data to encode.
+     *  \param frames       number of frames in `data`.
+     *  \param channels     number of interleaved channels in `data`.
+     *  \param block_frames number of frames per block. This is rounded
+     *                      up to an even number of at least two.
+     */
+    AadpcmBuffer(
+            const Aint* data,
+            size_t      frames,
+            Achan       channels,
+            size_t      block_frames = DEFAULT_BLOCK_FRAMES
+    );
+
+    /** Decodes a whole block.
+     *
+     *  \param[in]  block index of the block to decode.
+     *  \param[out] dst   interleaved output with room for
+     *                    \ref getBlockFrames() frames.
+     *  \return number of frames of audio in the block, which is less than
+     *          \ref getBlockFrames() for the last block.
+     */
+    size_t decode(size_t block, Aint* dst) const;
+
+    inline Achan          getChannelCount () const { return mChannels; }
+    inline size_t         getFrameCount   () const { return mFrames; }
+    inline size_t         getBlockFrames  () const { return mBlockFrames; }
+    inline size_t         getBlockCount   () const { return (mFrames + mBlockFrames - 1) / mBlockFrames; }
+    inline size_t         getBlockBytes   () const { return mBlockBytes; }
+
+    //! \return pointer to the first encoded block.
+    inline const uint8_t* data            () const { return mBlocks.data(); }
+
+    //! \return size of the encoded audio in bytes.
+    inline size_t         size            () const { return mBlocks.size(); }
+};
+
+/** Sequential reader over an \ref AadpcmBuffer.
+ *
+ *  Keeps the most recently decoded block so that a voice only decodes
+ *  the blocks it is about to play, one at a time. Decoding never
+ *  allocates once the reader has been attached to a buffer.
+ */
+class AadpcmReader
+{
+private:
+    const AadpcmBuffer* mBuffer;    //!< Buffer being read, or null
+    AiBuffer            mCache;     //!< Last decoded block
+    size_t              mBlock;     //!< Index of the cached block
+    size_t              mCached;    //!< Number of frames in the cached block
+
+    static constexpr size_t NO_BLOCK = ~size_t(0);
+
+public:
+    AadpcmReader() : mBuffer(nullptr), mCache(), mBlock(NO_BLOCK), mCached(0) { }
+
+    /** Attaches the reader to a buffer.
+     *  This allocates the block cache unless it is already large enough.
+     *  The buffer must outlive the reader or the next call to this.
+     */
+    void reset(const AadpcmBuffer* buffer);
+
+    /** Retrieves decoded frames.
+     *
+     *  \param[in]     frame  first frame to read.
+     *  \param[in,out] frames maximum number of frames to read, clamped to
+     *                        the end of the block holding `frame`.
+     *  \return pointer to `frames` interleaved frames starting at `frame`.
+     */
+    const Aint* fetch(size_t frame, size_t &frames);
+
+    //! \return buffer being read, or null.
+    inline const AadpcmBuffer* getBuffer() const { return mBuffer; }
+};
+
+}
+
+#endif
@@ -0,0 +1,61 @@
+//  AllocGuard.cpp :: Debug-mode heap allocation guard
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "AllocGuard.hpp"
+
+#ifdef DEBUG
+
+#include <cstdlib>
+#include <new>
+
+namespace awe {
+
+//! Number of allocation guards alive on the current thread.
+static thread_local unsigned tGuardDepth = 0;
+
+AallocGuard:: AallocGuard() { tGuardDepth += 1; }
+AallocGuard::~AallocGuard() { tGuardDepth -= 1; }
+
+bool AallocGuard::active() { return tGuardDepth != 0; }
+
+AallocPermit:: AallocPermit() : mDepth(tGuardDepth) { tGuardDepth = 0; }
+AallocPermit::~AallocPermit() { tGuardDepth = mDepth; }
+
+}
+
+static void* awe_guarded_alloc(std::size_t size)
+{
+    assert(!awe::AallocGuard::active() && "Heap allocation inside a real-time render call.");
+
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+static void awe_guarded_free(void* ptr)
+{
+    assert((ptr == nullptr || !awe::AallocGuard::active()) && "Heap deallocation inside a real-time render call.");
+    std::free(ptr);
+}
+
+void* operator new  (std::size_t size) { return awe_guarded_alloc(size); }
+void* operator new[](std::size_t size) { return awe_guarded_alloc(size); }
+
+void* operator new  (std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return awe_guarded_alloc(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return awe_guarded_alloc(size); } catch (...) { return nullptr; }
+}
+
+void operator delete  (void* ptr) noexcept { awe_guarded_free(ptr); }
+void operator delete[](void* ptr) noexcept { awe_guarded_free(ptr); }
+
+void operator delete  (void* ptr, const std::nothrow_t&) noexcept { awe_guarded_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { awe_guarded_free(ptr); }
+
+#endif
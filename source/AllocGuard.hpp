@@ -0,0 +1,64 @@
+//  AllocGuard.hpp :: Debug-mode heap allocation guard
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_ALLOCGUARD_H
+#define AWE_ALLOCGUARD_H
+
+#include "Define.hpp"
+
+namespace awe {
+
+/*! Scope guard that forbids heap allocation on the current thread.
+ *
+ *  In `DEBUG` builds, libawe replaces the global `operator new` and
+ *  `operator delete` with versions that assert if they are called while
+ *  an instance of this class is alive on the calling thread. This is used
+ *  to enforce the real-time contract of \ref awe::Asource::render().
+ *
+ *  Guards may be nested. In release builds this class does nothing.
+ */
+class AallocGuard
+{
+public:
+#ifdef DEBUG
+    AallocGuard();
+    ~AallocGuard();
+
+    //! \return true if heap allocation is forbidden on the calling thread.
+    static bool active();
+#else
+    AallocGuard() { }
+
+    static inline bool active() { return false; }
+#endif
+
+    AallocGuard(const AallocGuard&) = delete;
+    AallocGuard& operator=(const AallocGuard&) = delete;
+};
+
+/*! Scope that lifts all \ref AallocGuard instances on the current thread.
+ *
+ *  Only meant for diagnostics that allocate on purpose, such as the
+ *  \ref Aprofiler. In release builds this class does nothing.
+ */
+class AallocPermit
+{
+#ifdef DEBUG
+private:
+    unsigned mDepth;    //!< Guard depth to restore
+
+public:
+    AallocPermit();
+    ~AallocPermit();
+#else
+public:
+    AallocPermit() { }
+#endif
+
+    AallocPermit(const AallocPermit&) = delete;
+    AallocPermit& operator=(const AallocPermit&) = delete;
+};
+
+}
+
+#endif
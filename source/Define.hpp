@@ -24,6 +24,9 @@ using Afloat = float;   //!< Architecture-specific floating point data type
 using Achan  = uint8_t; //!< Channel count data type.
 //!@}
 
+//! Largest number of channels supported by samples, sources and tracks.
+static constexpr Achan MAX_CHANNELS = 32;
+
 //!@name Standard audio data containers
 //!@{
 template< typename T >
@@ -113,16 +116,21 @@ struct ArenderConfig {
     /** Rendering quality. */
     Quality quality;
 
+    /** Number of interleaved channels in the target buffer. */
+    Achan channels;
+
     /** Default constructor. */
     ArenderConfig(
         unsigned long sample_rate,
         unsigned long frame_count,
         unsigned long frame_offset = 0,
-        Quality q = Quality::DEFAULT
+        Quality q = Quality::DEFAULT,
+        Achan channel_count = 2
     )   : sampleRate(sample_rate)
         , frameCount(frame_count)
         , frameOffset(frame_offset)
         , quality(q)
+        , channels(channel_count)
     { }
 
 };
@@ -5,6 +5,9 @@
 #ifndef AWE_ENGINE_H
 #define AWE_ENGINE_H
 
+#include <algorithm>
+#include <stdexcept>
+#include "RenderGraph.hpp"
 #include "Sources/Track.hpp"
 #include "awePortAudio.hpp"
 
@@ -18,9 +21,40 @@ namespace awe {
  */
 class AEngine
 {
+public:
+    //! Audio engine rendering mode.
+    enum class Mode : uint8_t
+    {
+        /** Audio is rendered by \ref update() on the caller's thread and
+         *  queued into the output ring buffer ahead of time.
+         */
+        QUEUE = 0x0,
+
+        /** Audio is rendered by the audio device callback, one device
+         *  period at a time, straight into the device buffer. \ref update()
+         *  does nothing in this mode. All sources attached to the master
+         *  track must follow the real-time contract described in
+         *  \ref awe::Asource::render().
+         */
+        PULL  = 0x1
+    };
+
 protected:
     APortAudio      mOutputDevice;  //!< PortAudio output device wrapper
     Source::Track   mMasterTrack;   //!< Master output track
+    Mode            mMode;          //!< Rendering mode
+
+    std::unique_ptr<ArenderGraph>   mGraph; //!< Parallel track tree scheduler
+
+    //! PortAudio pull-mode render function.
+    static void render_callback(Afloat* output, unsigned long frames, void* engine)
+    {
+        Source::Track& track = static_cast<AEngine*>(engine)->mMasterTrack;
+
+        // Output silence rather than wait for a control thread.
+        if (track.try_render(output, frames) == false)
+            std::fill(output, output + frames * track.getChannelCount(), 0.0f);
+    }
 
 public:
     /** Output interface constructor
@@ -30,14 +64,22 @@ public:
      *                       process for every call to `update()`.
      *  \param device_type   PortAudio output device type to use for audio
      *                       output.
+     *  \param mode          Rendering mode. In \ref Mode::PULL mode, the
+     *                       output frame rate is also the device period.
      */
     AEngine(
         size_t sampling_rate = 48000,
         size_t op_frame_rate = 4096,
-        APortAudio::HostAPIType device_type = APortAudio::HostAPIType::Default
+        APortAudio::HostAPIType device_type = APortAudio::HostAPIType::Default,
+        Mode mode = Mode::QUEUE
     ) : mOutputDevice(),
-        mMasterTrack (sampling_rate, op_frame_rate, "Output to Device")
+        mMasterTrack (sampling_rate, op_frame_rate, "Output to Device"),
+        mMode        (mode),
+        mGraph       (nullptr)
     {
+        if (mMode == Mode::PULL)
+            mOutputDevice.setRenderer(&AEngine::render_callback, this);
+
         if (mOutputDevice.init(sampling_rate, op_frame_rate, device_type) == false)
             throw std::runtime_error("libawe [exception] Could not initialize output device.");
     }
@@ -53,6 +95,20 @@ public:
      */
     inline Source::Track& getMasterTrack() { return mMasterTrack; }
 
+    /*! Renders the tree of tracks under the master track in parallel.
+     *  \param pool worker pool to render tracks on, or `nullptr` to
+     *              render the whole tree on the calling thread.
+     *  \note This only applies to \ref Mode::QUEUE mode.
+     *  \see awe::ArenderGraph
+     */
+    inline void setThreadPool(std::shared_ptr<AThreadPool> pool)
+    {
+        mGraph.reset(pool ? new ArenderGraph(mMasterTrack, pool) : nullptr);
+    }
+
+    //! \return the rendering mode of this engine.
+    inline Mode getMode() const { return mMode; }
+
     /*! Pulls audio mix from master track and pushes them into the
      *  output device.
      *
@@ -64,20 +120,29 @@ public:
      *  and then mix them.
      *
      *  \return false if the output device buffer has sufficient data
-     *          for the next time the system requests for them.
+     *          for the next time the system requests for them, or if
+     *          the engine is running in \ref Mode::PULL mode.
      */
     virtual bool update()
     {
-        if (mOutputDevice.getFIFOBuffer().size() < mMasterTrack.getOutput().size())
+        if (mMode == Mode::PULL)
+            return false;
+
+        AfRingBuffer& queue = mOutputDevice.getRingBuffer();
+
+        if (queue.size () <  mMasterTrack.getOutput().size() &&
+            queue.space() >= mMasterTrack.getOutput().size())
         {
             // Process stuff
-            mMasterTrack.pull();
-            mMasterTrack.flip();
+            if (mGraph) {
+                mGraph->update();
+            } else {
+                mMasterTrack.pull();
+                mMasterTrack.flip();
+            }
 
-            // Push to output device buffer
-            mOutputDevice.getFIFOBuffer_mutex().lock();
-            mMasterTrack.push(mOutputDevice.getFIFOBuffer());
-            mOutputDevice.getFIFOBuffer_mutex().unlock();
+            // Push to output device buffer; the ring buffer is lock-free.
+            mMasterTrack.push(queue);
 
             return true;
         } else {
@@ -5,29 +5,74 @@
 #define AWE_FILTER_H
 
 #include "Define.hpp"
+#include "Planar.hpp"
 
 namespace awe {
 
 /* Define namespace for filters */
 namespace Filter {}
 
-/*! Audio filter interface.
- *  This class serves as an interface to all audio filtering objects.
+/*! Audio filter interface, independent of the channel count.
+ *
+ *  Filters are written against \ref Afilter, which fixes the number of
+ *  channels they process. This base lets objects that only learn their
+ *  channel count at run time, such as \ref awe::Source::Track, hold and
+ *  run a filter of any shape.
  */
-template< Achan Channels >
-class Afilter
+class AfilterBase
 {
 public:
     //! Virtual destructor
-    virtual ~Afilter() { }
+    virtual ~AfilterBase() { }
 
     //! Resets the filter to its initial state.
     virtual void reset_state() = 0;
 
-    /*! Filters input as stereo-channeled Afloat sample buffer.
+    /*! Filters an interleaved Afloat sample buffer.
      *  @param[in,out] buffer buffer to filter through
      */
     virtual void filter_buffer(AfBuffer &buffer) = 0;
+
+    /*! Filters the first `frames` frames of an interleaved Afloat sample
+     *  buffer and leaves the rest of it alone. The default implementation
+     *  filters the whole buffer through \ref filter_buffer().
+     *  @param[in,out] buffer buffer to filter through
+     *  @param[in]     frames number of frames to filter
+     */
+    virtual void filter_frames(AfBuffer &buffer, size_t frames) { (void) frames; filter_buffer(buffer); }
+
+    /*! Queries whether this filter implements \ref filter_planar().
+     *  A \ref Filter::Rack runs consecutive planar filters over one
+     *  planar copy of its buffer instead of the interleaved buffer.
+     *  @return true if \ref filter_planar() should be used.
+     */
+    virtual bool is_planar() const { return false; }
+
+    /*! Filters a planar sample buffer.
+     *  This must have the same effect as \ref filter_buffer(); it is only
+     *  called if \ref is_planar() returns true.
+     *  @param[in,out] buffer buffer to filter through
+     */
+    virtual void filter_planar(const AplanarView &buffer) { (void) buffer; }
+
+    /*! Queries whether this filter currently leaves every buffer as it
+     *  is, so that running it can be skipped.
+     */
+    virtual bool is_bypassed() const { return false; }
+
+    /*! Preallocates working memory for buffers of up to `frames` frames,
+     *  outside of the render path.
+     */
+    virtual void prepare(size_t frames) { (void) frames; }
+};
+
+/*! Audio filter interface.
+ *  This class serves as an interface to all audio filtering objects that
+ *  process buffers of `Channels` interleaved channels.
+ */
+template< Achan Channels >
+class Afilter : public AfilterBase
+{
 };
 
 //! Standard stereo-channel audio stream filter typedef
@@ -95,7 +95,12 @@ public:
 
     inline void filter_buffer(AfBuffer &buffer) override
     {
-        for(size_t i = 0; i < buffer.size(); i += 1)
+        filter_frames(buffer, buffer.size() / Channels);
+    }
+
+    inline void filter_frames(AfBuffer &buffer, size_t frames) override
+    {
+        for(size_t i = 0; i < frames * Channels; i += 1)
         {
             double L, M, H;
             L = M = H = buffer[i];
@@ -113,6 +118,29 @@ public:
         }
     }
 
+    inline bool is_planar() const override { return true; }
+
+    inline void filter_planar(const AplanarView &buffer) override
+    {
+        for(size_t i = 0; i < buffer.frames; i++)
+        {
+            for(Achan c = 0; c < Channels; c++)
+            {
+                Afloat* x = buffer.channel(c) + i;
+
+                double L, M, H;
+                L = M = H = *x;
+
+                mLP.process(c, L);
+                mHP.process(c, H);
+
+                M -= (L + H);
+
+                *x = static_cast<Afloat>(L * mLG + M * mMG + H * mHG);
+            }
+        }
+    }
+
 };
 
 }
@@ -76,6 +76,24 @@ namespace IIR
             }
         }
 
+        inline void process(const AplanarView& buffer) noexcept
+        {
+            assert(buffer.channels == Channels);
+
+            // Channels are independent; stepping them together per frame
+            // keeps several recursions in flight at once.
+            for(size_t i = 0; i < buffer.frames; i++)
+            {
+                for(Achan c = 0; c < Channels; c++)
+                {
+                    Afloat* x = buffer.channel(c) + i;
+                    double v = *x;
+                    process_one(mB, mA, mZ[c], v);
+                    *x = static_cast< Afloat >(v);
+                }
+            }
+        }
+
     };
 
 };
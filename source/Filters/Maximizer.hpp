@@ -90,12 +90,18 @@ public:
      *  \param buffer The audio buffer to filter.
      */
     void filter_buffer(AfBuffer &buffer) override
+    {
+        filter_frames(buffer, buffer.size() / Channels);
+    }
+
+    //! Performs maximization on the first `frames` frames of the buffer.
+    void filter_frames(AfBuffer &buffer, size_t frames) override
     {
         mPeakSample = 0.0f;
 
         Afloat* frame = buffer.data();
 
-        for(size_t i = 0; i < buffer.size(); i += Channels, frame += Channels)
+        for(size_t i = 0; i < frames * Channels; i += Channels, frame += Channels)
         {
             Afloat  framePeak = 0.0f;
 
@@ -3,6 +3,9 @@
 
 #include "Metering.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 namespace awe {
 namespace Filter {
 
@@ -11,20 +14,25 @@ AscMetering::AscMetering(Afloat freq, Afloat decay)
     , mDecay(decay)
     , mPeak ({0.0f, 0.0f})
     , mRMS  ({0.0f, 0.0f})
-    , mdOCI ({int16_t{0}, int16_t{0}})
+    , mdOCI ()
     , mdRMS ({0.0f, 0.0f})
 {
 
 }
 
 void AscMetering::filter_buffer(AfBuffer &buffer)
+{
+    filter_frames(buffer, buffer.size() / 2);
+}
+
+void AscMetering::filter_frames(AfBuffer &buffer, size_t frames)
 {
     mPeak *= 0;
     mRMS  *= 0;
 
     Asfloatf mSum({0.0f, 0.0f});
 
-    for(size_t i = 0; i < buffer.size() / 2; i++)
+    for(size_t i = 0; i < frames; i++)
     {
         Asfloatf m = Asfloatf::from_buffer(buffer, i);
         m.abs();
@@ -36,7 +44,39 @@ void AscMetering::filter_buffer(AfBuffer &buffer)
         mSum[1] += m[1] * m[1];
     }
 
-    mSum /= buffer.size() / 2;
+    update(mSum, frames);
+}
+
+void AscMetering::filter_planar(const AplanarView &buffer)
+{
+    const Afloat* const l = buffer.channel(0);
+    const Afloat* const r = buffer.channel(1);
+
+    // Both channels per frame, so that the two sums run side by side.
+    Afloat peakL = 0.0f, peakR = 0.0f;
+    Afloat sumL  = 0.0f, sumR  = 0.0f;
+
+    for(size_t i = 0; i < buffer.frames; i++)
+    {
+        Afloat const mL = std::abs(l[i]);
+        Afloat const mR = std::abs(r[i]);
+
+        peakL = std::max(peakL, mL);
+        peakR = std::max(peakR, mR);
+
+        sumL += mL * mL;
+        sumR += mR * mR;
+    }
+
+    mPeak[0] = peakL;
+    mPeak[1] = peakR;
+
+    update(Asfloatf({sumL, sumR}), buffer.frames);
+}
+
+void AscMetering::update(Asfloatf mSum, size_t frames)
+{
+    mSum /= frames;
 
     mRMS[0] = sqrt(mSum[0]);
     mRMS[1] = sqrt(mSum[1]);
@@ -30,6 +30,9 @@ private:
     Asintf      mdOCI;  //!< Overclip indicator
     Asfloatf    mdRMS;
 
+    //! Updates the RMS and decaying parameters from the sum of squares.
+    void update(Asfloatf sum, size_t frames);
+
 public:
     AscMetering(Afloat freq, Afloat decay);
 
@@ -45,6 +48,10 @@ public:
         mdRMS  *= 0;
     }
     virtual void filter_buffer(AfBuffer &buffer) override;
+    virtual void filter_frames(AfBuffer &buffer, size_t frames) override;
+
+    virtual bool is_planar() const override { return true; }
+    virtual void filter_planar(const AplanarView &buffer) override;
 };
 }
 }
@@ -66,19 +66,33 @@ public:
     inline void reset_state() override { reset(vol, pan); }
 
     void filter_buffer(AfBuffer &buffer) override
+    {
+        filter_frames(buffer, buffer.size() / Channels);
+    }
+
+    void filter_frames(AfBuffer &buffer, size_t frames) override
     {
         if (Channels == 1) {
             std::for_each(
-                    buffer.begin(), buffer.end(),
+                    buffer.begin(), buffer.begin() + frames,
                     [this](Afloat &value) { value *= vol; }
                     );
         } else {
-            for(AfBuffer::size_type i = 0; i < buffer.size() / Channels; i++)
-            {
-                Asfloatf frame = Asfloatf::from_buffer(buffer, i);
-                frame *= chgain;
-                frame.to_buffer(buffer, i);
-            }
+            apply_gain(buffer.data(), frames, chgain);
+        }
+    }
+
+    bool is_planar() const override { return true; }
+
+    void filter_planar(const AplanarView &buffer) override
+    {
+        for(Achan c = 0; c < Channels; c++)
+        {
+            Afloat* const x = buffer.channel(c);
+            Afloat  const g = (Channels == 1) ? vol : chgain[c];
+
+            for(size_t i = 0; i < buffer.frames; i++)
+                x[i] *= g;
         }
     }
 
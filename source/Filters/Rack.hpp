@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <memory>
 #include "../Filter.hpp"
+#include "../Profiler.hpp"
 
 namespace awe {
 namespace Filter {
@@ -21,22 +22,72 @@ public:
 
 private:
     std::vector< pointer_type > filters;
+    AplanarBuffer               planar;     //!< Planar copy of the buffer for planar filters
 
 public:
     Rack() {}
 
+    //! Preallocates the planar copy of the buffer and the filters.
+    inline void prepare(size_t frames) override {
+        planar.reset(Channels, frames);
+        for(const pointer_type &filter : filters)
+            filter->prepare(frames);
+    }
+
+    //! A rack is bypassed if it has no filters that would run.
+    inline bool is_bypassed() const override {
+        for(const pointer_type &filter : filters)
+            if (filter->is_bypassed() == false)
+                return false;
+        return true;
+    }
+
     inline void reset_state() override {
         for(pointer_type filter : filters)
             filter->reset_state();
     }
 
     inline void filter_buffer(AfBuffer &buffer) override {
-        for(pointer_type filter : filters)
-            filter->filter_buffer(buffer);
+        filter_frames(buffer, buffer.size() / Channels);
+    }
+
+    inline void filter_frames(AfBuffer &buffer, size_t frames) override {
+        assert(frames * Channels <= buffer.size());
+        size_t i = 0;
+
+        while(i < filters.size())
+        {
+            if (filters[i]->is_planar() == false) {
+                Aprofiler::Scope scope(Aprofiler::Kind::FILTER, filters[i].get(), frames);
+                filters[i]->filter_frames(buffer, frames);
+                i += 1;
+                continue;
+            }
+
+            // Convert only once for a run of planar filters. Shorter
+            // blocks use the front of the prepared planar copy.
+            if (planar.getFrameCount() < frames)
+                planar.reset(Channels, frames);
+
+            AplanarView const view = planar.view().slice(0, frames);
+            deinterleave(buffer.data(), view);
+
+            for(; i < filters.size() && filters[i]->is_planar(); i++) {
+                Aprofiler::Scope scope(Aprofiler::Kind::FILTER, filters[i].get(), frames);
+                filters[i]->filter_planar(view);
+            }
+
+            interleave(view, buffer.data());
+        }
     }
 
-    inline void attach_filter( filter_type* filter) { filters.push_back(std::shared_ptr<filter_type>(filter)); }
-    inline void attach_filter(pointer_type  filter) { filters.push_back(filter); }
+    //! Attaches a filter, preparing it like the rest if the rack was prepared.
+    inline void attach_filter(pointer_type  filter) {
+        if (planar.getFrameCount() != 0)
+            filter->prepare(planar.getFrameCount());
+        filters.push_back(filter);
+    }
+    inline void attach_filter( filter_type* filter) { attach_filter(pointer_type(filter)); }
     inline void detach_filter(size_t        filter) {
         auto it = filters.begin();
         while(it != filters.end())
@@ -50,6 +101,8 @@ public:
         }
     }
 
+    inline size_t count_filters() const { return filters.size(); }
+
     inline       pointer_type   getFilter(size_t filter)       { return filters[filter]; }
     inline const  filter_type* cgetFilter(size_t filter) const { return filters[filter].get(); }
 };
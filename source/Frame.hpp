@@ -8,10 +8,215 @@
 
 #include <algorithm>
 #include <array>
+#include <cassert>
+#include <cmath>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define AWE_FRAME_SSE
+#   include <emmintrin.h>
+#   if defined(__AVX__)
+#       define AWE_FRAME_AVX
+#       include <immintrin.h>
+#   endif
+#endif
 
 namespace awe
 {
 
+/*! Frame-wide arithmetic kernels.
+ *
+ *  These implement the same-shape operators of \ref Aframe and the
+ *  block-wise gain operations over raw sample pointers. The generic
+ *  template loops over each channel; stereo, quad and 7.1 `float` frames
+ *  have SSE specializations (AVX for 7.1, if enabled at compile time) so
+ *  that per-frame code compiles down to packed arithmetic.
+ *
+ *  \tparam T type of sample.
+ *  \tparam Channels number of samples in a frame.
+ */
+template< typename T, Achan Channels >
+struct AframeOps
+{
+    static inline void add(T* d, const T* s) { for(Achan c = 0; c < Channels; ++c) d[c] += s[c]; }
+    static inline void sub(T* d, const T* s) { for(Achan c = 0; c < Channels; ++c) d[c] -= s[c]; }
+    static inline void mul(T* d, const T* s) { for(Achan c = 0; c < Channels; ++c) d[c] *= s[c]; }
+    static inline void div(T* d, const T* s) { for(Achan c = 0; c < Channels; ++c) d[c] /= s[c]; }
+
+    static inline void add(T* d, const T& v) { for(Achan c = 0; c < Channels; ++c) d[c] += v; }
+    static inline void sub(T* d, const T& v) { for(Achan c = 0; c < Channels; ++c) d[c] -= v; }
+    static inline void mul(T* d, const T& v) { for(Achan c = 0; c < Channels; ++c) d[c] *= v; }
+    static inline void div(T* d, const T& v) { for(Achan c = 0; c < Channels; ++c) d[c] /= v; }
+
+    static inline void abs(T* d) { for(Achan c = 0; c < Channels; ++c) d[c] = std::abs(d[c]); }
+
+    //! Multiplies `frames` interleaved frames at `d` by the frame `g`.
+    static inline void scale_block(T* d, size_t frames, const T* g) {
+        T gl[Channels]; // `g` may alias `d`; keep it out of memory.
+        std::copy(g, g + Channels, gl);
+        for(size_t i = 0; i < frames; i++, d += Channels) mul(d, gl);
+    }
+
+    //! Adds `frames` interleaved frames at `s` multiplied by `g` onto `d`.
+    static inline void mix_block(T* d, const T* s, size_t frames, const T* g) {
+        T gl[Channels]; // See scale_block().
+        std::copy(g, g + Channels, gl);
+        for(size_t i = 0; i < frames; i++, d += Channels, s += Channels)
+            for(Achan c = 0; c < Channels; ++c) d[c] += s[c] * gl[c];
+    }
+};
+
+#ifdef AWE_FRAME_SSE
+
+/*! Stereo `float` frame kernels.
+ *  A single stereo frame is too narrow to gain from a vector register
+ *  round trip, so per-frame operations are spelt out per lane and left to
+ *  the compiler to pack; block operations process two frames per vector.
+ */
+template<>
+struct AframeOps< float, 2 >
+{
+    static inline __m128 load (const float* p) { return _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(p)); }
+    static inline void   store(float* p, __m128 x) { _mm_storel_pi(reinterpret_cast<__m64*>(p), x); }
+
+    static inline void add(float* d, const float* s) { d[0] += s[0]; d[1] += s[1]; }
+    static inline void sub(float* d, const float* s) { d[0] -= s[0]; d[1] -= s[1]; }
+    static inline void mul(float* d, const float* s) { d[0] *= s[0]; d[1] *= s[1]; }
+    static inline void div(float* d, const float* s) { d[0] /= s[0]; d[1] /= s[1]; }
+
+    static inline void add(float* d, const float& v) { d[0] += v; d[1] += v; }
+    static inline void sub(float* d, const float& v) { d[0] -= v; d[1] -= v; }
+    static inline void mul(float* d, const float& v) { d[0] *= v; d[1] *= v; }
+    static inline void div(float* d, const float& v) { d[0] /= v; d[1] /= v; }
+
+    static inline void abs(float* d) { d[0] = std::fabs(d[0]); d[1] = std::fabs(d[1]); }
+
+    // Two frames per vector.
+    static inline void scale_block(float* d, size_t frames, const float* g) {
+        __m128 const gg = _mm_movelh_ps(load(g), load(g));
+        size_t i = 0;
+        for(; i + 2 <= frames; i += 2, d += 4)
+            _mm_storeu_ps(d, _mm_mul_ps(_mm_loadu_ps(d), gg));
+        if (i < frames)
+            store(d, _mm_mul_ps(load(d), gg));
+    }
+
+    static inline void mix_block(float* d, const float* s, size_t frames, const float* g) {
+        __m128 const gg = _mm_movelh_ps(load(g), load(g));
+        size_t i = 0;
+        for(; i + 2 <= frames; i += 2, d += 4, s += 4)
+            _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d), _mm_mul_ps(_mm_loadu_ps(s), gg)));
+        if (i < frames)
+            store(d, _mm_add_ps(load(d), _mm_mul_ps(load(s), gg)));
+    }
+};
+
+//! Quad `float` frame kernels; a frame is one vector.
+template<>
+struct AframeOps< float, 4 >
+{
+    static inline __m128 load (const float* p) { return _mm_loadu_ps(p); }
+    static inline void   store(float* p, __m128 x) { _mm_storeu_ps(p, x); }
+
+    static inline void add(float* d, const float* s) { store(d, _mm_add_ps(load(d), load(s))); }
+    static inline void sub(float* d, const float* s) { store(d, _mm_sub_ps(load(d), load(s))); }
+    static inline void mul(float* d, const float* s) { store(d, _mm_mul_ps(load(d), load(s))); }
+    static inline void div(float* d, const float* s) { store(d, _mm_div_ps(load(d), load(s))); }
+
+    static inline void add(float* d, const float& v) { store(d, _mm_add_ps(load(d), _mm_set1_ps(v))); }
+    static inline void sub(float* d, const float& v) { store(d, _mm_sub_ps(load(d), _mm_set1_ps(v))); }
+    static inline void mul(float* d, const float& v) { store(d, _mm_mul_ps(load(d), _mm_set1_ps(v))); }
+    static inline void div(float* d, const float& v) { store(d, _mm_div_ps(load(d), _mm_set1_ps(v))); }
+
+    static inline void abs(float* d) { store(d, _mm_andnot_ps(_mm_set1_ps(-0.0f), load(d))); }
+
+    static inline void scale_block(float* d, size_t frames, const float* g) {
+        __m128 const gg = load(g);
+        for(size_t i = 0; i < frames; i++, d += 4)
+            store(d, _mm_mul_ps(load(d), gg));
+    }
+
+    static inline void mix_block(float* d, const float* s, size_t frames, const float* g) {
+        __m128 const gg = load(g);
+        for(size_t i = 0; i < frames; i++, d += 4, s += 4)
+            store(d, _mm_add_ps(load(d), _mm_mul_ps(load(s), gg)));
+    }
+};
+
+#ifdef AWE_FRAME_AVX
+
+//! 7.1 `float` frame kernels; a frame is one AVX vector.
+template<>
+struct AframeOps< float, 8 >
+{
+    static inline __m256 load (const float* p) { return _mm256_loadu_ps(p); }
+    static inline void   store(float* p, __m256 x) { _mm256_storeu_ps(p, x); }
+
+    static inline void add(float* d, const float* s) { store(d, _mm256_add_ps(load(d), load(s))); }
+    static inline void sub(float* d, const float* s) { store(d, _mm256_sub_ps(load(d), load(s))); }
+    static inline void mul(float* d, const float* s) { store(d, _mm256_mul_ps(load(d), load(s))); }
+    static inline void div(float* d, const float* s) { store(d, _mm256_div_ps(load(d), load(s))); }
+
+    static inline void add(float* d, const float& v) { store(d, _mm256_add_ps(load(d), _mm256_set1_ps(v))); }
+    static inline void sub(float* d, const float& v) { store(d, _mm256_sub_ps(load(d), _mm256_set1_ps(v))); }
+    static inline void mul(float* d, const float& v) { store(d, _mm256_mul_ps(load(d), _mm256_set1_ps(v))); }
+    static inline void div(float* d, const float& v) { store(d, _mm256_div_ps(load(d), _mm256_set1_ps(v))); }
+
+    static inline void abs(float* d) { store(d, _mm256_andnot_ps(_mm256_set1_ps(-0.0f), load(d))); }
+
+    static inline void scale_block(float* d, size_t frames, const float* g) {
+        __m256 const gg = load(g);
+        for(size_t i = 0; i < frames; i++, d += 8)
+            store(d, _mm256_mul_ps(load(d), gg));
+    }
+
+    static inline void mix_block(float* d, const float* s, size_t frames, const float* g) {
+        __m256 const gg = load(g);
+        for(size_t i = 0; i < frames; i++, d += 8, s += 8)
+            store(d, _mm256_add_ps(load(d), _mm256_mul_ps(load(s), gg)));
+    }
+};
+
+#else
+
+//! 7.1 `float` frame kernels; a frame is two SSE vectors.
+template<>
+struct AframeOps< float, 8 >
+{
+    using Q = AframeOps< float, 4 >;
+
+    static inline void add(float* d, const float* s) { Q::add(d, s); Q::add(d + 4, s + 4); }
+    static inline void sub(float* d, const float* s) { Q::sub(d, s); Q::sub(d + 4, s + 4); }
+    static inline void mul(float* d, const float* s) { Q::mul(d, s); Q::mul(d + 4, s + 4); }
+    static inline void div(float* d, const float* s) { Q::div(d, s); Q::div(d + 4, s + 4); }
+
+    static inline void add(float* d, const float& v) { Q::add(d, v); Q::add(d + 4, v); }
+    static inline void sub(float* d, const float& v) { Q::sub(d, v); Q::sub(d + 4, v); }
+    static inline void mul(float* d, const float& v) { Q::mul(d, v); Q::mul(d + 4, v); }
+    static inline void div(float* d, const float& v) { Q::div(d, v); Q::div(d + 4, v); }
+
+    static inline void abs(float* d) { Q::abs(d); Q::abs(d + 4); }
+
+    static inline void scale_block(float* d, size_t frames, const float* g) {
+        __m128 const g0 = Q::load(g), g1 = Q::load(g + 4);
+        for(size_t i = 0; i < frames; i++, d += 8) {
+            Q::store(d    , _mm_mul_ps(Q::load(d    ), g0));
+            Q::store(d + 4, _mm_mul_ps(Q::load(d + 4), g1));
+        }
+    }
+
+    static inline void mix_block(float* d, const float* s, size_t frames, const float* g) {
+        __m128 const g0 = Q::load(g), g1 = Q::load(g + 4);
+        for(size_t i = 0; i < frames; i++, d += 8, s += 8) {
+            Q::store(d    , _mm_add_ps(Q::load(d    ), _mm_mul_ps(Q::load(s    ), g0)));
+            Q::store(d + 4, _mm_add_ps(Q::load(d + 4), _mm_mul_ps(Q::load(s + 4), g1)));
+        }
+    }
+};
+
+#endif
+#endif
+
 /*! Preprocessor definition to disable some const operators.
  *  C++11 STL array does not support
  */
@@ -29,6 +234,7 @@ namespace awe
 template< typename T, Achan Channels >
 struct Aframe {
 
+    using             ops = AframeOps< T, Channels >;
     using  container_type = std::array< T, Channels >;
     using      value_type = typename container_type::value_type;
     using       reference = typename container_type::      reference;
@@ -82,10 +288,10 @@ struct Aframe {
 //! \{
 
     // T as argument
-    void operator+= (const T& v) { for(T& u : data) u += v; }
-    void operator-= (const T& v) { for(T& u : data) u -= v; }
-    void operator*= (const T& v) { for(T& u : data) u *= v; }
-    void operator/= (const T& v) { for(T& u : data) u /= v; }
+    void operator+= (const T& v) { ops::add(data.data(), v); }
+    void operator-= (const T& v) { ops::sub(data.data(), v); }
+    void operator*= (const T& v) { ops::mul(data.data(), v); }
+    void operator/= (const T& v) { ops::div(data.data(), v); }
 
     Aframe operator+ (const T& v) const { Aframe f(data); f += v; return f; }
     Aframe operator- (const T& v) const { Aframe f(data); f -= v; return f; }
@@ -93,6 +299,17 @@ struct Aframe {
     Aframe operator/ (const T& v) const { Aframe f(data); f /= v; return f; }
 
 
+    // awe::Aframe<T> of the same shape as argument
+    void operator+= (const Aframe& v) { ops::add(data.data(), v.data.data()); }
+    void operator-= (const Aframe& v) { ops::sub(data.data(), v.data.data()); }
+    void operator*= (const Aframe& v) { ops::mul(data.data(), v.data.data()); }
+    void operator/= (const Aframe& v) { ops::div(data.data(), v.data.data()); }
+
+    Aframe operator+ (const Aframe& v) const { Aframe f(data); f += v; return f; }
+    Aframe operator- (const Aframe& v) const { Aframe f(data); f -= v; return f; }
+    Aframe operator* (const Aframe& v) const { Aframe f(data); f *= v; return f; }
+    Aframe operator/ (const Aframe& v) const { Aframe f(data); f /= v; return f; }
+
     // awe::Aframe<T> as argument
     template< Achan channels > void operator+= (const Aframe<T, channels>& v) {
         for(Achan c = 0; c < std::min<>(Channels, channels); ++c) data[c] += v[c];
@@ -170,19 +387,17 @@ struct Aframe {
 //! \name Algorithms
 
     //! Passes samples in this frame through a function.
-    void operator()(std::function<void(T&) F> function) {
+    void operator()(std::function<void(T&)> function) {
         for(T& u : data) function(u);
     }
 
     //! Passes samples in this frame through a function.
-    void operator()(std::function<void(const T&) F> function) const {
-        for(T& u : data) function(u);
+    void operator()(std::function<void(const T&)> function) const {
+        for(const T& u : data) function(u);
     }
 
     //! Converts all sample values in the frame into absolute values.
-    void abs() {
-        for(T& u : data) u = std::abs(u);
-    }
+    void abs() { ops::abs(data.data()); }
 
 #ifdef MSC_VER
     //! \return Maximum sample value in frame.
@@ -225,7 +440,7 @@ Aframe< Afloat, Channels > to_Afloatf(Aframe< Aint, Channels > i)
     for(Achan c = 0; c < Channels; c += 1) {
         f[c] = to_Afloat(i[c]);
     }
-    return i;
+    return f;
 }
 
 template< Achan Channels >
@@ -246,7 +461,7 @@ Aframe< Afloat, DChannels > to_Afloatf(Aframe< Aint, SChannels > i)
     for(Achan c = 0; c < C; c += 1) {
         f[c] = to_Afloat(i[c]);
     }
-    return i;
+    return f;
 }
 
 template< Achan SChannels, Achan DChannels >
@@ -260,6 +475,43 @@ Aframe< Aint, DChannels > to_Aintf(Aframe< Afloat, SChannels > f)
     return i;
 }
 //! \}
+
+//! \name Block-wise frame operations
+//! \{
+
+/*! Multiplies every frame of an interleaved buffer by a gain frame.
+ *  \param buffer interleaved buffer of `frames` frames.
+ *  \param frames number of frames to process.
+ *  \param gain   gain applied onto each channel.
+ */
+template< typename T, Achan Channels >
+inline void apply_gain(T* buffer, size_t frames, const Aframe< T, Channels > &gain)
+{
+    AframeOps< T, Channels >::scale_block(buffer, frames, gain.data.data());
+}
+
+//! Multiplies every frame of an interleaved buffer by a gain frame.
+template< typename T, Achan Channels >
+inline void apply_gain(Abuffer<T> &buffer, const Aframe< T, Channels > &gain)
+{
+    assert(buffer.size() % Channels == 0);
+    apply_gain(buffer.data(), buffer.size() / Channels, gain);
+}
+
+/*! Mixes an interleaved buffer onto another through a gain frame.
+ *
+ *      dst[i][c] += src[i][c] * gain[c]
+ *
+ *  \param dst    interleaved buffer to mix onto.
+ *  \param src    interleaved buffer to mix from.
+ *  \param frames number of frames to mix.
+ *  \param gain   gain applied onto each channel.
+ */
+template< typename T, Achan Channels >
+inline void mix_gain(T* dst, const T* src, size_t frames, const Aframe< T, Channels > &gain)
+{
+    AframeOps< T, Channels >::mix_block(dst, src, frames, gain.data.data());
+}
 //! \}
 
 }
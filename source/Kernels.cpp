@@ -0,0 +1,481 @@
+//  Kernels.cpp :: Vectorized mixing kernels
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "Kernels.hpp"
+
+#include <algorithm>
+#include "Frame.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#   define AWE_KERNEL_X86
+#   include <immintrin.h>
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#   endif
+#endif
+
+#if defined(__GNUC__)
+#   define AWE_TARGET(isa) __attribute__((target(isa)))
+#else
+#   define AWE_TARGET(isa)
+#endif
+
+namespace awe {
+namespace Kernel {
+
+//!@name Scalar kernels
+//!@{
+
+static void scalar_mix_i16_mono(Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    for(size_t i = 0; i < frames; i++) {
+        Afloat const v = to_Afloat(src[i]);
+        dst[i*2  ] += v * gainL;
+        dst[i*2+1] += v * gainR;
+    }
+}
+
+static void scalar_mix_i16_stereo(Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    for(size_t i = 0; i < frames; i++) {
+        dst[i*2  ] += to_Afloat(src[i*2  ]) * gainL;
+        dst[i*2+1] += to_Afloat(src[i*2+1]) * gainR;
+    }
+}
+
+static void scalar_mix_f32_mono(Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    for(size_t i = 0; i < frames; i++) {
+        dst[i*2  ] += src[i] * gainL;
+        dst[i*2+1] += src[i] * gainR;
+    }
+}
+
+static void scalar_mix_f32_stereo(Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    for(size_t i = 0; i < frames; i++) {
+        dst[i*2  ] += src[i*2  ] * gainL;
+        dst[i*2+1] += src[i*2+1] * gainR;
+    }
+}
+
+//!@}
+
+//!@name Multichannel kernels
+//!@{
+
+//! Branchless \ref to_Afloat(), scaling by reciprocals like the SIMD kernels.
+static inline Afloat to_sample(Aint v)
+{
+    return Afloat(v) * (v < 0 ? 1.0f / 32768.0f : 1.0f / 32767.0f);
+}
+
+static inline Afloat to_sample(Afloat v) { return v; }
+
+//! Mixes frames into frames of the same shape, for a fixed channel count.
+template< Achan Channels >
+static void same_mix_i16(Afloat* dst, const Aint* src, size_t frames, const Afloat* gain)
+{
+    // Local copy, as `gain` could alias `dst`.
+    Afloat g[Channels];
+    std::copy(gain, gain + Channels, g);
+
+    for(size_t i = 0; i < frames; i++, dst += Channels, src += Channels)
+        for(Achan c = 0; c < Channels; c++)
+            dst[c] += to_sample(src[c]) * g[c];
+}
+
+//! Mixes frames into frames of the same shape, for a fixed channel count.
+template< Achan Channels >
+static void same_mix_f32(Afloat* dst, const Afloat* src, size_t frames, const Afloat* gain)
+{
+    AframeOps< Afloat, Channels >::mix_block(dst, src, frames, gain);
+}
+
+//! Mixes frames of any shape into frames of any shape.
+template< typename T >
+static void map_mix(Afloat* dst, Achan dstChannels, const T* src, Achan srcChannels, size_t frames, const Afloat* gain)
+{
+    Afloat g[MAX_CHANNELS];
+    std::copy(gain, gain + dstChannels, g);
+
+    if (srcChannels == 1) {
+        for(size_t i = 0; i < frames; i++, dst += dstChannels) {
+            Afloat const v = to_sample(src[i]);
+            for(Achan c = 0; c < dstChannels; c++)
+                dst[c] += v * g[c];
+        }
+    } else if (dstChannels >= 2 && (srcChannels == 2 || dstChannels == 2)) {
+        // Stereo samples on surround tracks and the reverse are common
+        // enough to be worth unrolling. Both sides have at least two
+        // channels here; mono targets take the loop below.
+        for(size_t i = 0; i < frames; i++, dst += dstChannels, src += srcChannels) {
+            dst[0] += to_sample(src[0]) * g[0];
+            dst[1] += to_sample(src[1]) * g[1];
+        }
+    } else {
+        Achan const channels = std::min(srcChannels, dstChannels);
+        for(size_t i = 0; i < frames; i++, dst += dstChannels, src += srcChannels)
+            for(Achan c = 0; c < channels; c++)
+                dst[c] += to_sample(src[c]) * g[c];
+    }
+}
+
+//!@}
+
+#ifdef AWE_KERNEL_X86
+
+//!@name SSE2 kernels
+//!@{
+
+//! Converts eight 16-bit integers into two vectors of normalized floats.
+AWE_TARGET("sse2")
+static inline void sse2_cvt_i16(__m128i x, __m128 &lo, __m128 &hi)
+{
+    __m128 const kn = _mm_set1_ps(1.0f / 32768.0f);
+    __m128 const kp = _mm_set1_ps(1.0f / 32767.0f);
+    __m128 const z  = _mm_setzero_ps();
+
+    // Sign-extend by unpacking into the high halves and shifting back.
+    lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+    hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+
+    __m128 const ml = _mm_cmplt_ps(lo, z);
+    __m128 const mh = _mm_cmplt_ps(hi, z);
+
+    lo = _mm_mul_ps(lo, _mm_or_ps(_mm_and_ps(ml, kn), _mm_andnot_ps(ml, kp)));
+    hi = _mm_mul_ps(hi, _mm_or_ps(_mm_and_ps(mh, kn), _mm_andnot_ps(mh, kp)));
+}
+
+//! Adds `v` onto four floats at `dst`.
+AWE_TARGET("sse2")
+static inline void sse2_acc(Afloat* dst, __m128 v)
+{
+    _mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), v));
+}
+
+AWE_TARGET("sse2")
+static void sse2_mix_i16_mono(Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    __m128 const g = _mm_setr_ps(gainL, gainR, gainL, gainR);
+
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8)
+    {
+        __m128 lo, hi;
+        sse2_cvt_i16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), lo, hi);
+
+        sse2_acc(dst + i*2     , _mm_mul_ps(_mm_unpacklo_ps(lo, lo), g));
+        sse2_acc(dst + i*2 +  4, _mm_mul_ps(_mm_unpackhi_ps(lo, lo), g));
+        sse2_acc(dst + i*2 +  8, _mm_mul_ps(_mm_unpacklo_ps(hi, hi), g));
+        sse2_acc(dst + i*2 + 12, _mm_mul_ps(_mm_unpackhi_ps(hi, hi), g));
+    }
+
+    scalar_mix_i16_mono(dst + i*2, src + i, frames - i, gainL, gainR);
+}
+
+AWE_TARGET("sse2")
+static void sse2_mix_i16_stereo(Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    __m128 const g = _mm_setr_ps(gainL, gainR, gainL, gainR);
+
+    size_t i = 0;
+    for(; i + 4 <= frames; i += 4)
+    {
+        __m128 lo, hi;
+        sse2_cvt_i16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i*2)), lo, hi);
+
+        sse2_acc(dst + i*2    , _mm_mul_ps(lo, g));
+        sse2_acc(dst + i*2 + 4, _mm_mul_ps(hi, g));
+    }
+
+    scalar_mix_i16_stereo(dst + i*2, src + i*2, frames - i, gainL, gainR);
+}
+
+AWE_TARGET("sse2")
+static void sse2_mix_f32_mono(Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    __m128 const g = _mm_setr_ps(gainL, gainR, gainL, gainR);
+
+    size_t i = 0;
+    for(; i + 4 <= frames; i += 4)
+    {
+        __m128 const v = _mm_loadu_ps(src + i);
+
+        sse2_acc(dst + i*2    , _mm_mul_ps(_mm_unpacklo_ps(v, v), g));
+        sse2_acc(dst + i*2 + 4, _mm_mul_ps(_mm_unpackhi_ps(v, v), g));
+    }
+
+    scalar_mix_f32_mono(dst + i*2, src + i, frames - i, gainL, gainR);
+}
+
+AWE_TARGET("sse2")
+static void sse2_mix_f32_stereo(Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    __m128 const g = _mm_setr_ps(gainL, gainR, gainL, gainR);
+
+    size_t i = 0;
+    for(; i + 2 <= frames; i += 2)
+        sse2_acc(dst + i*2, _mm_mul_ps(_mm_loadu_ps(src + i*2), g));
+
+    scalar_mix_f32_stereo(dst + i*2, src + i*2, frames - i, gainL, gainR);
+}
+
+//!@}
+
+//!@name AVX2 kernels
+//!@{
+
+//! Converts eight 16-bit integers into a vector of normalized floats.
+AWE_TARGET("avx2")
+static inline __m256 avx2_cvt_i16(const Aint* src)
+{
+    __m256 const kn = _mm256_set1_ps(1.0f / 32768.0f);
+    __m256 const kp = _mm256_set1_ps(1.0f / 32767.0f);
+
+    __m256 const v = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src))));
+
+    return _mm256_mul_ps(v, _mm256_blendv_ps(kp, kn, _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LT_OQ)));
+}
+
+//! Adds `v` onto eight floats at `dst`.
+AWE_TARGET("avx2")
+static inline void avx2_acc(Afloat* dst, __m256 v)
+{
+    _mm256_storeu_ps(dst, _mm256_add_ps(_mm256_loadu_ps(dst), v));
+}
+
+//! Mixes eight mono samples into sixteen interleaved stereo samples.
+AWE_TARGET("avx2")
+static inline void avx2_acc_mono(Afloat* dst, __m256 v, __m256 g)
+{
+    // [0 0 1 1 | 4 4 5 5] and [2 2 3 3 | 6 6 7 7]
+    __m256 const lo = _mm256_unpacklo_ps(v, v);
+    __m256 const hi = _mm256_unpackhi_ps(v, v);
+
+    avx2_acc(dst    , _mm256_mul_ps(_mm256_permute2f128_ps(lo, hi, 0x20), g));
+    avx2_acc(dst + 8, _mm256_mul_ps(_mm256_permute2f128_ps(lo, hi, 0x31), g));
+}
+
+AWE_TARGET("avx2")
+static void avx2_mix_i16_mono(Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    __m256 const g = _mm256_setr_ps(gainL, gainR, gainL, gainR, gainL, gainR, gainL, gainR);
+
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8)
+        avx2_acc_mono(dst + i*2, avx2_cvt_i16(src + i), g);
+
+    scalar_mix_i16_mono(dst + i*2, src + i, frames - i, gainL, gainR);
+}
+
+AWE_TARGET("avx2")
+static void avx2_mix_i16_stereo(Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    __m256 const g = _mm256_setr_ps(gainL, gainR, gainL, gainR, gainL, gainR, gainL, gainR);
+
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8) {
+        avx2_acc(dst + i*2    , _mm256_mul_ps(avx2_cvt_i16(src + i*2    ), g));
+        avx2_acc(dst + i*2 + 8, _mm256_mul_ps(avx2_cvt_i16(src + i*2 + 8), g));
+    }
+
+    scalar_mix_i16_stereo(dst + i*2, src + i*2, frames - i, gainL, gainR);
+}
+
+AWE_TARGET("avx2")
+static void avx2_mix_f32_mono(Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    __m256 const g = _mm256_setr_ps(gainL, gainR, gainL, gainR, gainL, gainR, gainL, gainR);
+
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8)
+        avx2_acc_mono(dst + i*2, _mm256_loadu_ps(src + i), g);
+
+    scalar_mix_f32_mono(dst + i*2, src + i, frames - i, gainL, gainR);
+}
+
+AWE_TARGET("avx2")
+static void avx2_mix_f32_stereo(Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    __m256 const g = _mm256_setr_ps(gainL, gainR, gainL, gainR, gainL, gainR, gainL, gainR);
+
+    size_t i = 0;
+    for(; i + 4 <= frames; i += 4)
+        avx2_acc(dst + i*2, _mm256_mul_ps(_mm256_loadu_ps(src + i*2), g));
+
+    scalar_mix_f32_stereo(dst + i*2, src + i*2, frames - i, gainL, gainR);
+}
+
+//!@}
+
+#endif // AWE_KERNEL_X86
+
+//!@name Runtime dispatch
+//!@{
+
+//! Kernel function table.
+struct Table
+{
+    void (*mix_i16_mono  )(Afloat*, const Aint  *, size_t, Afloat, Afloat);
+    void (*mix_i16_stereo)(Afloat*, const Aint  *, size_t, Afloat, Afloat);
+    void (*mix_f32_mono  )(Afloat*, const Afloat*, size_t, Afloat, Afloat);
+    void (*mix_f32_stereo)(Afloat*, const Afloat*, size_t, Afloat, Afloat);
+};
+
+static const Table sScalarTable = {
+    scalar_mix_i16_mono, scalar_mix_i16_stereo,
+    scalar_mix_f32_mono, scalar_mix_f32_stereo
+};
+
+#ifdef AWE_KERNEL_X86
+static const Table sSSE2Table = {
+    sse2_mix_i16_mono, sse2_mix_i16_stereo,
+    sse2_mix_f32_mono, sse2_mix_f32_stereo
+};
+
+static const Table sAVX2Table = {
+    avx2_mix_i16_mono, avx2_mix_i16_stereo,
+    avx2_mix_f32_mono, avx2_mix_f32_stereo
+};
+#endif
+
+//! Currently selected instruction set extension.
+static Isa& current_isa()
+{
+    static Isa isa = detect_isa();
+    return isa;
+}
+
+//! Currently selected kernel table.
+static inline const Table& table()
+{
+    switch (current_isa())
+    {
+#ifdef AWE_KERNEL_X86
+    case Isa::AVX2: return sAVX2Table;
+    case Isa::SSE2: return sSSE2Table;
+#endif
+    default:        return sScalarTable;
+    }
+}
+
+Isa detect_isa()
+{
+#if defined(AWE_KERNEL_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return Isa::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return Isa::SSE2;
+#elif defined(AWE_KERNEL_X86) && defined(_MSC_VER)
+    int r[4];
+
+    __cpuid(r, 0);
+    int const leaves = r[0];
+
+    __cpuid(r, 1);
+    bool const sse2    = (r[3] & (1 << 26)) != 0;
+    bool const osxsave = (r[2] & (1 << 27)) != 0;
+    bool const avx     = (r[2] & (1 << 28)) != 0;
+
+    // AVX2 also needs the OS to save the YMM registers.
+    if (leaves >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(r, 7, 0);
+        if ((r[1] & (1 << 5)) != 0)
+            return Isa::AVX2;
+    }
+
+    if (sse2)
+        return Isa::SSE2;
+#endif
+
+    return Isa::SCALAR;
+}
+
+Isa selected_isa()
+{
+    return current_isa();
+}
+
+bool select_isa(Isa isa)
+{
+    if (static_cast<uint8_t>(isa) > static_cast<uint8_t>(detect_isa()))
+        return false;
+
+    current_isa() = isa;
+    return true;
+}
+
+const char* isa_name(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::SSE2: return "sse2";
+    case Isa::AVX2: return "avx2";
+    default:        return "scalar";
+    }
+}
+
+void mix_i16_mono  (Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    table().mix_i16_mono  (dst, src, frames, gainL, gainR);
+}
+
+void mix_i16_stereo(Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    table().mix_i16_stereo(dst, src, frames, gainL, gainR);
+}
+
+void mix_f32_mono  (Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    table().mix_f32_mono  (dst, src, frames, gainL, gainR);
+}
+
+void mix_f32_stereo(Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR)
+{
+    table().mix_f32_stereo(dst, src, frames, gainL, gainR);
+}
+
+void mix_i16(Afloat* dst, Achan dstChannels, const Aint* src, Achan srcChannels, size_t frames, const Afloat* gain)
+{
+    if (dstChannels == 2 && srcChannels == 1)
+        return table().mix_i16_mono  (dst, src, frames, gain[0], gain[1]);
+
+    if (dstChannels == srcChannels) {
+        switch (srcChannels)
+        {
+        case 1: return same_mix_i16<1>(dst, src, frames, gain);
+        case 2: return table().mix_i16_stereo(dst, src, frames, gain[0], gain[1]);
+        case 6: return same_mix_i16<6>(dst, src, frames, gain);
+        case 8: return same_mix_i16<8>(dst, src, frames, gain);
+        }
+    }
+
+    map_mix(dst, dstChannels, src, srcChannels, frames, gain);
+}
+
+void mix_f32(Afloat* dst, Achan dstChannels, const Afloat* src, Achan srcChannels, size_t frames, const Afloat* gain)
+{
+    if (dstChannels == 2 && srcChannels == 1)
+        return table().mix_f32_mono  (dst, src, frames, gain[0], gain[1]);
+
+    if (dstChannels == srcChannels) {
+        switch (srcChannels)
+        {
+        case 1: return same_mix_f32<1>(dst, src, frames, gain);
+        case 2: return table().mix_f32_stereo(dst, src, frames, gain[0], gain[1]);
+        case 6: return same_mix_f32<6>(dst, src, frames, gain);
+        case 8: return same_mix_f32<8>(dst, src, frames, gain);
+        }
+    }
+
+    map_mix(dst, dstChannels, src, srcChannels, frames, gain);
+}
+
+//!@}
+
+}
+}
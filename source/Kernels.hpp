@@ -0,0 +1,131 @@
+//  Kernels.hpp :: Vectorized mixing kernels
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_KERNELS_H
+#define AWE_KERNELS_H
+
+#include "Define.hpp"
+
+namespace awe {
+
+/*! Vectorized block processing kernels.
+ *
+ *  Every kernel has a portable scalar implementation and, on x86
+ *  processors, SSE2 and AVX2 implementations. The fastest implementation
+ *  supported by the processor is selected once at start-up; it can be
+ *  overridden through \ref select_isa() for testing and benchmarking.
+ *
+ *  Integer samples are converted with the same scaling as
+ *  \ref awe::to_Afloat().
+ */
+namespace Kernel {
+
+//! Instruction set extension used by the kernels.
+enum class Isa : uint8_t
+{
+    SCALAR  = 0x0,  //!< Portable C++ implementation.
+    SSE2    = 0x1,  //!< x86 SSE2 implementation.
+    AVX2    = 0x2   //!< x86 AVX2 implementation.
+};
+
+//! \return the best instruction set extension supported by this processor.
+Isa detect_isa();
+
+//! \return the instruction set extension currently used by the kernels.
+Isa selected_isa();
+
+/*! Selects the instruction set extension used by the kernels.
+ *  \warning This is not thread-safe; do not call this while any kernel
+ *           may be running.
+ *  \return false if the processor does not support `isa`, in which case
+ *          the selection is left unchanged.
+ */
+bool select_isa(Isa isa);
+
+//! \return a printable name of an instruction set extension.
+const char* isa_name(Isa isa);
+
+/*! Mixes a mono 16-bit integer block into an interleaved stereo buffer.
+ *
+ *      dst[2i  ] += to_Afloat(src[i]) * gainL
+ *      dst[2i+1] += to_Afloat(src[i]) * gainR
+ *
+ *  \param dst    interleaved stereo output buffer.
+ *  \param src    mono input samples.
+ *  \param frames number of frames to mix.
+ *  \param gainL  gain applied onto the left channel.
+ *  \param gainR  gain applied onto the right channel.
+ */
+void mix_i16_mono  (Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR);
+
+/*! Mixes an interleaved stereo 16-bit integer block into an interleaved
+ *  stereo buffer.
+ *
+ *      dst[2i  ] += to_Afloat(src[2i  ]) * gainL
+ *      dst[2i+1] += to_Afloat(src[2i+1]) * gainR
+ */
+void mix_i16_stereo(Afloat* dst, const Aint* src, size_t frames, Afloat gainL, Afloat gainR);
+
+/*! Mixes a mono floating point block into an interleaved stereo buffer.
+ *
+ *      dst[2i  ] += src[i] * gainL
+ *      dst[2i+1] += src[i] * gainR
+ */
+void mix_f32_mono  (Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR);
+
+/*! Mixes an interleaved stereo floating point block into an interleaved
+ *  stereo buffer.
+ *
+ *      dst[2i  ] += src[2i  ] * gainL
+ *      dst[2i+1] += src[2i+1] * gainR
+ */
+void mix_f32_stereo(Afloat* dst, const Afloat* src, size_t frames, Afloat gainL, Afloat gainR);
+
+/*! Mixes an interleaved 16-bit integer block into an interleaved buffer
+ *  with any number of channels.
+ *
+ *  A mono block is spread over every target channel. Otherwise, each
+ *  source channel is mixed into the target channel of the same index;
+ *  source channels past the last target channel are dropped.
+ *
+ *      dst[i*dstChannels + c] += to_Afloat(src[i*srcChannels + c]) * gain[c]
+ *
+ *  Mono and stereo blocks into stereo buffers use the kernels above, and
+ *  1, 6 and 8 channel blocks into buffers of the same shape have unrolled
+ *  implementations.
+ *
+ *  \param dst         interleaved output buffer.
+ *  \param dstChannels number of channels in the output buffer.
+ *  \param src         interleaved input samples.
+ *  \param srcChannels number of channels in the input samples.
+ *  \param frames      number of frames to mix.
+ *  \param gain        `dstChannels` gains, one for each output channel.
+ */
+void mix_i16(Afloat* dst, Achan dstChannels, const Aint* src, Achan srcChannels, size_t frames, const Afloat* gain);
+
+/*! Mixes an interleaved floating point block into an interleaved buffer
+ *  with any number of channels, the same way as \ref mix_i16().
+ */
+void mix_f32(Afloat* dst, Achan dstChannels, const Afloat* src, Achan srcChannels, size_t frames, const Afloat* gain);
+
+/*! Spreads a left and right channel volume over `channels` gains.
+ *  The first two channels get `left` and `right`; every other channel
+ *  gets their mean. A single channel gets the mean as well.
+ */
+inline void spread_gain(Afloat* gain, Achan channels, Afloat left, Afloat right)
+{
+    Afloat const mean = (left + right) * 0.5f;
+
+    for(Achan c = 0; c < channels; c++)
+        gain[c] = mean;
+
+    if (channels >= 2) {
+        gain[0] = left;
+        gain[1] = right;
+    }
+}
+
+}
+}
+
+#endif
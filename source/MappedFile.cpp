@@ -0,0 +1,246 @@
+//  MappedFile.cpp :: Read-only memory-mapped file
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "MappedFile.hpp"
+#include "Sample.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+namespace awe {
+
+// AmappedFile
+#ifdef _WIN32
+
+AmappedFile::AmappedFile(const std::string &file)
+    : mData(nullptr)
+    , mSize(0)
+    , mName(file)
+    , mFile(INVALID_HANDLE_VALUE)
+    , mMapping(nullptr)
+{
+    mFile = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (mFile == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "libawe [error] %s: cannot open file (error %lu).\n", file.c_str(), GetLastError());
+        return;
+    }
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(mFile, &size) == 0 || size.QuadPart == 0) {
+        fprintf(stderr, "libawe [error] %s: cannot map an empty file.\n", file.c_str());
+        return;
+    }
+
+    mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMapping == nullptr) {
+        fprintf(stderr, "libawe [error] %s: cannot map file (error %lu).\n", file.c_str(), GetLastError());
+        return;
+    }
+
+    mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    mSize = (mData != nullptr) ? static_cast<size_t>(size.QuadPart) : 0;
+
+    if (mData == nullptr)
+        fprintf(stderr, "libawe [error] %s: cannot map file (error %lu).\n", file.c_str(), GetLastError());
+}
+
+AmappedFile::~AmappedFile()
+{
+    if (mData != nullptr)
+        UnmapViewOfFile(mData);
+    if (mMapping != nullptr)
+        CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mFile);
+}
+
+#else
+
+AmappedFile::AmappedFile(const std::string &file)
+    : mData(nullptr)
+    , mSize(0)
+    , mName(file)
+{
+    int const fd = ::open(file.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "libawe [error] %s: %s.\n", file.c_str(), strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "libawe [error] %s: cannot map an empty file.\n", file.c_str());
+        close(fd);
+        return;
+    }
+
+    void* const ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "libawe [error] %s: %s.\n", file.c_str(), strerror(errno));
+        return;
+    }
+
+    mData = static_cast<const char*>(ptr);
+    mSize = static_cast<size_t>(st.st_size);
+}
+
+AmappedFile::~AmappedFile()
+{
+    if (mData != nullptr)
+        munmap(const_cast<char*>(mData), mSize);
+}
+
+#endif
+
+
+/* RIFF WAVE header parsing */
+
+static inline uint16_t read_le16(const char* p)
+{
+    const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+    return static_cast<uint16_t>(u[0] | (u[1] << 8));
+}
+
+static inline uint32_t read_le32(const char* p)
+{
+    const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+    return static_cast<uint32_t>(u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32_t>(u[3]) << 24));
+}
+
+//! \return true if Aint samples are stored little-endian on this host.
+static inline bool is_little_endian()
+{
+    uint16_t const probe = 1;
+    return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+}
+
+//! Wraps the audio data of a mapping into a sample.
+static std::shared_ptr<Asample> make_mapped_sample(
+        const std::shared_ptr<AmappedFile> &map,
+        size_t              offset,
+        size_t              bytes,
+        Achan               chan,
+        unsigned long       rate,
+        Asample::Format     format = Asample::Format::INT16
+) {
+    size_t const width = (format == Asample::Format::FLOAT32) ? sizeof(Afloat) : sizeof(Aint);
+
+    // Samples must be aligned and in native byte order to be used as is.
+    if (is_little_endian() == false || (offset % width) != 0)
+        return nullptr;
+
+    std::shared_ptr<AiBuffer> none;
+    auto sample = std::make_shared<Asample>(none, chan, 1.0f, rate, map->getName());
+
+    size_t const length = (bytes / (width * chan)) * chan;
+
+    if (format == Asample::Format::FLOAT32)
+        sample->setSource(map, reinterpret_cast<const Afloat*>(map->data() + offset), length);
+    else
+        sample->setSource(map, reinterpret_cast<const Aint*>(map->data() + offset), length, 1.0f);
+
+    return sample;
+}
+
+// Asample memory-mapped load functions
+std::shared_ptr<Asample> Asample::map(const std::string &file)
+{
+    auto mapping = std::make_shared<AmappedFile>(file);
+    if (mapping->is_open() == false)
+        return nullptr;
+
+    const char* const p = mapping->data();
+    size_t      const n = mapping->size();
+
+    if (n < 12 || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0)
+        return nullptr;
+
+    uint16_t format = 0, chan = 0, bits = 0;
+    uint32_t rate   = 0;
+    size_t   offset = 0, bytes = 0;
+    bool     has_fmt = false, has_data = false;
+
+    for (size_t pos = 12; pos + 8 <= n && !has_data; )
+    {
+        const char* const id   = p + pos;
+        size_t      const body = pos + 8;
+        size_t      const len  = std::min<size_t>(read_le32(p + pos + 4), n - body);
+
+        if (memcmp(id, "fmt ", 4) == 0 && len >= 16) {
+            format  = read_le16(p + body     );
+            chan    = read_le16(p + body +  2);
+            rate    = read_le32(p + body +  4);
+            bits    = read_le16(p + body + 14);
+            has_fmt = true;
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the actual format in the sub-format GUID.
+            if (format == 0xFFFE && len >= 40)
+                format = read_le16(p + body + 24);
+        } else if (memcmp(id, "data", 4) == 0) {
+            offset   = body;
+            bytes    = len;
+            has_data = true;
+        }
+
+        pos = body + len + (len & 1);
+    }
+
+    if (!has_fmt || !has_data || chan < 1 || chan > MAX_CHANNELS || rate == 0)
+        return nullptr;
+
+    /****/ if (format == 0x0001 && bits == 16) {
+        return make_mapped_sample(mapping, offset, bytes, chan, rate, Asample::Format::INT16);
+    } else if (format == 0x0003 && bits == 32) {
+        return make_mapped_sample(mapping, offset, bytes, chan, rate, Asample::Format::FLOAT32);
+    } else {
+        return nullptr;
+    }
+}
+
+std::shared_ptr<Asample> Asample::map_raw(
+        const std::string &file,
+        Achan              chan,
+        unsigned long      rate,
+        size_t             offset
+) {
+    if (chan < 1 || chan > MAX_CHANNELS) {
+        fprintf(stderr, "libawe [error] %s: libawe supports 1 to %u channels.\n", file.c_str(), unsigned(MAX_CHANNELS));
+        return nullptr;
+    }
+
+    auto mapping = std::make_shared<AmappedFile>(file);
+    if (mapping->is_open() == false || offset >= mapping->size())
+        return nullptr;
+
+    return make_mapped_sample(mapping, offset, mapping->size() - offset, chan, rate);
+}
+
+std::shared_ptr<Asample> Asample::open(const std::string &file, Format format)
+{
+    auto sample = map(file);
+    if (sample)
+        return sample;
+
+    return std::make_shared<Asample>(file, format);
+}
+
+}
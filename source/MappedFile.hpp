@@ -0,0 +1,55 @@
+//  MappedFile.hpp :: Read-only memory-mapped file
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_MAPPEDFILE_H
+#define AWE_MAPPEDFILE_H
+
+#include <string>
+#include "Define.hpp"
+
+namespace awe {
+
+/** Read-only memory mapping of a whole file.
+ *
+ *  The file is mapped with `mmap()` on POSIX systems and with
+ *  `MapViewOfFile()` on Windows. Pages are loaded lazily by the operating
+ *  system on first access and are shared through the page cache with
+ *  every other process mapping the same file. The mapping is released
+ *  when this object is destroyed.
+ */
+class AmappedFile
+{
+private:
+    const char* mData;  //!< Pointer to the first byte of the mapping
+    size_t      mSize;  //!< Size of the mapping in bytes
+    std::string mName;  //!< Path to mapped file
+
+#ifdef _WIN32
+    void*       mFile;      //!< Windows file handle
+    void*       mMapping;   //!< Windows file mapping handle
+#endif
+
+public:
+    /** Maps a file into memory.
+     *
+     *  \warning This function leaves the object closed if it fails to map
+     *           the file; check \ref is_open() before using it.
+     *
+     *  \param file Path to file to map.
+     */
+    AmappedFile(const std::string &file);
+
+    AmappedFile(const AmappedFile&) = delete;
+    AmappedFile& operator=(const AmappedFile&) = delete;
+
+    virtual ~AmappedFile();
+
+    inline bool        is_open() const { return mData != nullptr; }
+    inline const char* data   () const { return mData; }
+    inline size_t      size   () const { return mSize; }
+    inline std::string getName() const { return mName; }
+};
+
+}
+
+#endif
@@ -0,0 +1,98 @@
+//  OfflineEngine.cpp :: Faster-than-real-time render engine
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "OfflineEngine.hpp"
+
+#include <chrono>
+#include <mutex>
+
+namespace awe {
+
+AOfflineEngine::AOfflineEngine(size_t sampling_rate, size_t op_frame_rate, Achan channels)
+    : mMasterTrack   (sampling_rate, op_frame_rate, "Output to Buffer", 0, 32, channels)
+    , mGraph         (nullptr)
+    , mRenderedFrames(0)
+    , mRenderSeconds (0.0)
+{ }
+
+size_t AOfflineEngine::render_block()
+{
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point const t0 = Clock::now();
+
+    if (mGraph) {
+        mGraph->update();
+    } else {
+        mMasterTrack.pull();
+        mMasterTrack.flip();
+    }
+
+    Clock::time_point const t1 = Clock::now();
+
+    size_t const frames = mMasterTrack.getConfig().frameCount;
+
+    mRenderedFrames += frames;
+    mRenderSeconds  += std::chrono::duration<double>(t1 - t0).count();
+
+    return frames;
+}
+
+size_t AOfflineEngine::render(AfBuffer &target, size_t frames)
+{
+    size_t done = 0;
+
+    // The active source count is taken by each pull, so always render one
+    // block to pick up sources started since the last one.
+    while ((frames == 0) ? (done == 0 || mMasterTrack.count_active_sources() != 0) : done < frames)
+    {
+        size_t const n = render_block();
+
+        std::lock_guard<std::mutex> o_lock(mMasterTrack.getMutex());
+        Source::Track::View const output = mMasterTrack.getView();
+
+        if (output.silent)
+            target.resize(target.size() + n * output.channels, 0.0f);
+        else
+            target.insert(target.end(), output.data, output.data + n * output.channels);
+
+        done += n;
+    }
+
+    return done;
+}
+
+size_t AOfflineEngine::render(AsndfileWriter &target, size_t frames)
+{
+    assert(target.getChannelCount() == mMasterTrack.getChannelCount()
+            && "Sound file and master track channel counts differ.");
+
+    size_t done = 0;
+
+    // See render(AfBuffer&, size_t).
+    while ((frames == 0) ? (done == 0 || mMasterTrack.count_active_sources() != 0) : done < frames)
+    {
+        size_t const n = render_block();
+
+        std::lock_guard<std::mutex> o_lock(mMasterTrack.getMutex());
+        if (target.write(mMasterTrack.getView().data, n) != n)
+            break;
+
+        done += n;
+    }
+
+    return done;
+}
+
+double AOfflineEngine::getRealtimeFactor() const
+{
+    if (mRenderedFrames == 0 || mRenderSeconds <= 0.0)
+        return 0.0;
+
+    double const audioSeconds =
+        static_cast<double>(mRenderedFrames) / mMasterTrack.getConfig().sampleRate;
+
+    return audioSeconds / mRenderSeconds;
+}
+
+}
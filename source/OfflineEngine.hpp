@@ -0,0 +1,116 @@
+//  OfflineEngine.hpp :: Faster-than-real-time render engine
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_OFFLINE_ENGINE_H
+#define AWE_OFFLINE_ENGINE_H
+
+#include "RenderGraph.hpp"
+#include "Sources/Track.hpp"
+#include "awesndfile.hpp"
+
+namespace awe {
+
+/*! Offline audio render interface.
+ *
+ *  This class renders the master track as fast as the processor allows
+ *  instead of pacing it against an audio device, which makes it usable
+ *  on machines without any audio hardware. The rendered audio is
+ *  appended to a buffer in memory or written to a sound file through
+ *  \ref awe::AsndfileWriter.
+ *
+ *  The time spent rendering is measured so that the render speed can be
+ *  reported as a multiple of real-time playback speed.
+ */
+class AOfflineEngine
+{
+protected:
+    Source::Track   mMasterTrack;   //!< Master output track
+
+    std::unique_ptr<ArenderGraph>   mGraph; //!< Parallel track tree scheduler
+
+    unsigned long long  mRenderedFrames;  //!< Frames rendered so far
+    double              mRenderSeconds;   //!< Wall-clock time spent rendering
+
+    /*! Renders one block of audio into the master track output buffer.
+     *  \return number of frames rendered.
+     */
+    size_t render_block();
+
+public:
+    /** Offline render engine constructor
+     *  \param sampling_rate Output sampling rate.
+     *  \param op_frame_rate Number of frames of audio data to render per
+     *                       block.
+     *  \param channels      Number of output channels.
+     */
+    AOfflineEngine(
+        size_t sampling_rate = 48000,
+        size_t op_frame_rate = 4096,
+        Achan  channels      = 2
+    );
+
+    virtual ~AOfflineEngine() { }
+
+    /*! Retrieves the master output track which the render engine
+     *  renders data from.
+     *  \return a reference to the master track object.
+     */
+    inline Source::Track& getMasterTrack() { return mMasterTrack; }
+
+    /*! Renders the tree of tracks under the master track in parallel.
+     *  \param pool worker pool to render tracks on, or `nullptr` to
+     *              render the whole tree on the calling thread.
+     *  \see awe::ArenderGraph
+     */
+    inline void setThreadPool(std::shared_ptr<AThreadPool> pool)
+    {
+        mGraph.reset(pool ? new ArenderGraph(mMasterTrack, pool) : nullptr);
+    }
+
+    /*! Renders the master track into a buffer.
+     *
+     *  Audio is rendered in whole blocks, so the buffer may grow by up
+     *  to one block more than requested.
+     *
+     *  \param[out] target interleaved buffer to append audio to, with the
+     *                     channel count of the master track.
+     *  \param[in]  frames number of frames to render, or 0 to render
+     *                     at least one block and then until the master
+     *                     track runs out of active sources.
+     *  \return number of frames appended to the buffer.
+     */
+    size_t render(AfBuffer &target, size_t frames = 0);
+
+    /*! Renders the master track into a sound file.
+     *  \param[out] target sound file writer to write audio into, with the
+     *                     channel count of the master track.
+     *  \param[in]  frames number of frames to render, or 0 to render
+     *                     at least one block and then until the master
+     *                     track runs out of active sources.
+     *  \return number of frames written into the file.
+     */
+    size_t render(AsndfileWriter &target, size_t frames = 0);
+
+    //! \return number of frames rendered since construction or \ref reset_stats().
+    inline unsigned long long getRenderedFrames() const { return mRenderedFrames; }
+
+    //! \return wall-clock seconds spent rendering since construction or \ref reset_stats().
+    inline double getRenderTime() const { return mRenderSeconds; }
+
+    /*! Retrieves the render speed as a multiple of real-time playback.
+     *  \return seconds of audio rendered per second of processing time,
+     *          or 0 if nothing has been rendered yet.
+     */
+    double getRealtimeFactor() const;
+
+    //! Resets the render speed statistics.
+    inline void reset_stats()
+    {
+        mRenderedFrames = 0;
+        mRenderSeconds  = 0.0;
+    }
+};
+
+}
+
+#endif
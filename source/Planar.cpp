@@ -0,0 +1,109 @@
+//  Planar.cpp :: Planar multichannel audio buffer
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "Planar.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace awe {
+
+//! Number of samples in one alignment unit.
+static constexpr size_t AlignedSamples = PLANAR_ALIGNMENT / sizeof(Afloat);
+
+AplanarBuffer::AplanarBuffer(Achan channels, size_t frames)
+    : mStorage  ()
+    , mData     (nullptr)
+    , mStride   (0)
+    , mFrames   (0)
+    , mChannels (0)
+{
+    reset(channels, frames);
+}
+
+AplanarBuffer::AplanarBuffer(const AplanarBuffer &other)
+    : AplanarBuffer(other.mChannels, other.mFrames)
+{
+    if (mData != nullptr)
+        std::memcpy(mData, other.mData, mStride * mChannels * sizeof(Afloat));
+}
+
+AplanarBuffer& AplanarBuffer::operator=(const AplanarBuffer &other)
+{
+    if (this != &other) {
+        reset(other.mChannels, other.mFrames);
+        if (mData != nullptr)
+            std::memcpy(mData, other.mData, mStride * mChannels * sizeof(Afloat));
+    }
+    return *this;
+}
+
+void AplanarBuffer::reset(Achan channels, size_t frames)
+{
+    // Round the length of each channel up to whole alignment units so
+    // that every channel starts on an aligned address.
+    size_t const stride = (frames + AlignedSamples - 1) / AlignedSamples * AlignedSamples;
+    size_t const size   = stride * channels + AlignedSamples;
+
+    if (mStorage.size() < size)
+        mStorage.resize(size);
+
+    // Samples to skip from the start of the storage to the first aligned one.
+    uintptr_t const base = reinterpret_cast<uintptr_t>(mStorage.data());
+    size_t    const skip = (PLANAR_ALIGNMENT - base % PLANAR_ALIGNMENT) % PLANAR_ALIGNMENT / sizeof(Afloat);
+
+    mData     = mStorage.data() + skip;
+    mStride   = stride;
+    mFrames   = frames;
+    mChannels = channels;
+
+    clear();
+}
+
+void AplanarBuffer::clear()
+{
+    std::fill(mData, mData + mStride * mChannels, 0.0f);
+}
+
+void deinterleave(const Afloat* src, const AplanarView &dst)
+{
+    /****/ if (dst.channels == 1) {
+        std::memcpy(dst.data, src, dst.frames * sizeof(Afloat));
+    } else if (dst.channels == 2) {
+        Afloat* const l = dst.channel(0);
+        Afloat* const r = dst.channel(1);
+        for (size_t i = 0; i < dst.frames; i++) {
+            l[i] = src[i*2  ];
+            r[i] = src[i*2+1];
+        }
+    } else {
+        for (Achan c = 0; c < dst.channels; c++) {
+            Afloat* const d = dst.channel(c);
+            for (size_t i = 0; i < dst.frames; i++)
+                d[i] = src[i * dst.channels + c];
+        }
+    }
+}
+
+void interleave(const AplanarView &src, Afloat* dst)
+{
+    /****/ if (src.channels == 1) {
+        std::memcpy(dst, src.data, src.frames * sizeof(Afloat));
+    } else if (src.channels == 2) {
+        const Afloat* const l = src.channel(0);
+        const Afloat* const r = src.channel(1);
+        for (size_t i = 0; i < src.frames; i++) {
+            dst[i*2  ] = l[i];
+            dst[i*2+1] = r[i];
+        }
+    } else {
+        for (Achan c = 0; c < src.channels; c++) {
+            const Afloat* const s = src.channel(c);
+            for (size_t i = 0; i < src.frames; i++)
+                dst[i * src.channels + c] = s[i];
+        }
+    }
+}
+
+}
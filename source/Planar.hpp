@@ -0,0 +1,102 @@
+//  Planar.hpp :: Planar multichannel audio buffer
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_PLANAR_H
+#define AWE_PLANAR_H
+
+#include <cassert>
+#include <vector>
+#include "Define.hpp"
+
+namespace awe {
+
+//! Alignment of every channel in a planar buffer, in bytes.
+static constexpr size_t PLANAR_ALIGNMENT = 64;
+
+/*! Non-owning view of planar audio data.
+ *
+ *  Channel `c` holds `frames` samples starting at `channel(c)`, and
+ *  channels are `stride` samples apart. Views are cheap to copy and to
+ *  slice; a view of a whole \ref AplanarBuffer has every channel aligned
+ *  to \ref PLANAR_ALIGNMENT bytes.
+ */
+struct AplanarView
+{
+    Afloat* data;       //!< First sample of the first channel
+    size_t  stride;     //!< Distance between channels, in samples
+    size_t  frames;     //!< Number of samples in each channel
+    Achan   channels;   //!< Number of channels
+
+    inline Afloat* channel(Achan c) const
+    {
+        assert(c < channels);
+        return data + c * stride;
+    }
+
+    //! \return a view over `count` frames starting at frame `begin`.
+    inline AplanarView slice(size_t begin, size_t count) const
+    {
+        assert(begin + count <= frames);
+        return { data + begin, stride, count, channels };
+    }
+};
+
+/*! Planar (structure-of-arrays) multichannel audio buffer.
+ *
+ *  Samples are stored one channel after another rather than interleaved
+ *  frame by frame as in \ref AfBuffer, so that per-channel processing is
+ *  a plain loop over contiguous memory. Every channel starts on a
+ *  \ref PLANAR_ALIGNMENT byte boundary.
+ */
+class AplanarBuffer
+{
+private:
+    std::vector<Afloat> mStorage;   //!< Channel data, with room for alignment
+    Afloat            * mData;      //!< First sample of the first channel
+    size_t              mStride;    //!< Distance between channels, in samples
+    size_t              mFrames;    //!< Number of samples in each channel
+    Achan               mChannels;  //!< Number of channels
+
+public:
+    AplanarBuffer(Achan channels = 0, size_t frames = 0);
+
+    AplanarBuffer(const AplanarBuffer &other);
+    AplanarBuffer& operator=(const AplanarBuffer &other);
+
+    AplanarBuffer(AplanarBuffer&&) = default;
+    AplanarBuffer& operator=(AplanarBuffer&&) = default;
+
+    /*! Resizes the buffer and clears it.
+     *  This only allocates if the buffer grows past its capacity.
+     */
+    void reset(Achan channels, size_t frames);
+
+    //! Sets every sample to zero.
+    void clear();
+
+    inline Achan  getChannelCount() const { return mChannels; }
+    inline size_t getFrameCount  () const { return mFrames; }
+    inline size_t getStride      () const { return mStride; }
+
+    inline       Afloat* channel(Achan c)       { assert(c < mChannels); return mData + c * mStride; }
+    inline const Afloat* channel(Achan c) const { assert(c < mChannels); return mData + c * mStride; }
+
+    //! \return a view over the whole buffer.
+    inline AplanarView view() { return { mData, mStride, mFrames, mChannels }; }
+};
+
+/*! Splits interleaved frames into a planar view.
+ *  \param[in]  src interleaved frames with `dst.channels` channels.
+ *  \param[out] dst planar view to write `dst.frames` frames into.
+ */
+void deinterleave(const Afloat* src, const AplanarView &dst);
+
+/*! Merges a planar view into interleaved frames.
+ *  \param[in]  src planar view to read `src.frames` frames from.
+ *  \param[out] dst interleaved frames with `src.channels` channels.
+ */
+void interleave(const AplanarView &src, Afloat* dst);
+
+}
+
+#endif
@@ -0,0 +1,389 @@
+//  Profiler.cpp :: Render time profiler
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "AllocGuard.hpp"
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+namespace awe {
+
+namespace {
+
+//! Profiled object on a track.
+struct Key
+{
+    const void* track;
+    const void* item;
+
+    bool operator==(const Key &other) const {
+        return track == other.track && item == other.item;
+    }
+};
+
+struct KeyHash
+{
+    size_t operator()(const Key &key) const {
+        std::hash<const void*> const h;
+        return h(key.track) * 31 + h(key.item);
+    }
+};
+
+//! Single profiled call kept for the trace.
+struct Event
+{
+    size_t                      entry;  //!< Index into ThreadData::entries
+    size_t                      frames;
+    Aprofiler::Clock::time_point start;
+    Aprofiler::Clock::time_point end;
+};
+
+/*! Measurements recorded by one thread.
+ *
+ *  The recording thread only shares `entries` and `trace` with readers,
+ *  under `mutex`. Readers hold it just long enough to copy the counters
+ *  and to swap `trace` with the preallocated `spare`; everything else is
+ *  done on their own copies, so formatting and file I/O never hold up a
+ *  rendering thread.
+ */
+struct ThreadData
+{
+    std::mutex                              mutex;      //!< Guards the recorded data against readers
+    unsigned                                tid;        //!< Thread number in the trace
+    std::unordered_map<Key, size_t, KeyHash> index;     //!< Object to entry index
+    std::vector<Aprofiler::Entry>           entries;
+    std::vector<Event>                      trace;      //!< Events not drained yet
+    size_t                                  traced;     //!< Events recorded since the last reset
+    size_t                                  traceLimit;
+
+    // Owned by readers, under gMutex.
+    std::vector<Aprofiler::Entry>           seen;       //!< Copy of entries as of the last drain
+    std::vector<Event>                      history;    //!< Drained events
+    std::vector<Event>                      spare;      //!< Empty trace buffer to swap in
+};
+
+std::mutex                               gMutex;            //!< Guards the globals below
+std::vector<std::shared_ptr<ThreadData>> gThreads;          //!< Registered threads; outlive them
+size_t                                   gTraceLimit = 0;   //!< Trace events per thread
+Aprofiler::Clock::time_point             gEpoch = Aprofiler::Clock::now();
+
+thread_local ThreadData        * tData      = nullptr;
+thread_local const void        * tTrackKey  = nullptr;
+thread_local const std::string * tTrackName = nullptr;
+
+ThreadData* thread_data()
+{
+    if (tData != nullptr)
+        return tData;
+
+    std::shared_ptr<ThreadData> data = std::make_shared<ThreadData>();
+
+    std::lock_guard<std::mutex> lock(gMutex);
+    data->tid        = static_cast<unsigned>(gThreads.size()) + 1;
+    data->traced     = 0;
+    data->traceLimit = gTraceLimit;
+    data->trace.reserve(gTraceLimit);
+    gThreads.push_back(data);
+
+    tData = data.get();
+    return tData;
+}
+
+std::string type_name(const std::type_info &type)
+{
+#if defined(__GNUG__)
+    int status = 0;
+    char* const name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    if (status == 0 && name != nullptr) {
+        std::string const result(name);
+        free(name);
+        return result;
+    }
+#endif
+    return type.name();
+}
+
+//! Writes a string as a JSON string literal.
+void write_json_string(FILE* file, const std::string &str)
+{
+    fputc('"', file);
+    for (char const c : str) {
+        /****/ if (c == '"' || c == '\\') {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            fprintf(file, "\\u%04x", static_cast<unsigned>(c));
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+double to_us(Aprofiler::Clock::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+//! Moves what a thread recorded since the last drain to the reader side, with gMutex lock.
+void drain(ThreadData &data)
+{
+    // Allocate before taking the lock so that the swap is all it waits on.
+    data.spare.reserve(data.traceLimit);
+
+    {
+        std::lock_guard<std::mutex> lock(data.mutex);
+
+        size_t const known = std::min(data.seen.size(), data.entries.size());
+
+        for (size_t i = 0; i < known; i++) {
+            Aprofiler::Entry &copy = data.seen[i];
+            const Aprofiler::Entry &entry = data.entries[i];
+            copy.calls   = entry.calls;
+            copy.frames  = entry.frames;
+            copy.seconds = entry.seconds;
+            copy.peak    = entry.peak;
+        }
+
+        // Only objects seen for the first time have their names copied.
+        data.seen.insert(data.seen.end(), data.entries.begin() + known, data.entries.end());
+
+        data.trace.swap(data.spare);
+    }
+
+    data.history.insert(data.history.end(), data.spare.begin(), data.spare.end());
+    data.spare.clear();
+}
+
+//! Copy of the trace of one thread, made for writing outside of the locks.
+struct TraceCopy
+{
+    unsigned                        tid;
+    std::vector<Aprofiler::Entry>   entries;
+    std::vector<Event>              events;
+};
+
+}
+
+std::atomic<bool> Aprofiler::sEnabled(false);
+
+Aprofiler::TrackScope::TrackScope(const void* track, const std::string &name)
+    : mActive   (is_enabled())
+    , mPrevKey  (nullptr)
+    , mPrevName (nullptr)
+{
+    if (mActive == false)
+        return;
+
+    mPrevKey  = tTrackKey;
+    mPrevName = tTrackName;
+    tTrackKey  = track;
+    tTrackName = &name;
+}
+
+Aprofiler::TrackScope::~TrackScope()
+{
+    if (mActive == false)
+        return;
+
+    tTrackKey  = mPrevKey;
+    tTrackName = mPrevName;
+}
+
+void Aprofiler::record(
+        Kind kind, const void* item, const std::type_info &type, size_t frames,
+        Clock::time_point start, Clock::time_point end
+) {
+    // New threads and objects are registered on first sight.
+    AallocPermit permit;
+
+    ThreadData* const data = thread_data();
+    std::lock_guard<std::mutex> lock(data->mutex);
+
+    Key const key = { tTrackKey, item };
+    auto it = data->index.find(key);
+
+    if (it == data->index.end())
+    {
+        char addr[32];
+        snprintf(addr, sizeof(addr), "@%p", item);
+
+        Entry entry;
+        entry.track   = tTrackName != nullptr ? *tTrackName : std::string();
+        entry.name    = type_name(type) + addr;
+        entry.kind    = kind;
+        entry.calls   = 0;
+        entry.frames  = 0;
+        entry.seconds = 0.0;
+        entry.peak    = 0.0;
+
+        data->entries.push_back(entry);
+        it = data->index.emplace(key, data->entries.size() - 1).first;
+    }
+
+    double const seconds = std::chrono::duration<double>(end - start).count();
+
+    Entry &entry = data->entries[it->second];
+    entry.calls   += 1;
+    entry.frames  += frames;
+    entry.seconds += seconds;
+    entry.peak     = std::max(entry.peak, seconds);
+
+    if (data->traced < data->traceLimit && data->trace.size() < data->trace.capacity()) {
+        Event const event = { it->second, frames, start, end };
+        data->trace.push_back(event);
+        data->traced += 1;
+    }
+}
+
+void Aprofiler::enable(size_t trace_events)
+{
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        gTraceLimit = trace_events;
+
+        for (const std::shared_ptr<ThreadData> &data : gThreads) {
+            std::lock_guard<std::mutex> dataLock(data->mutex);
+            data->traceLimit = trace_events;
+            data->trace.reserve(trace_events);
+            data->spare.reserve(trace_events);
+        }
+    }
+
+    sEnabled.store(true);
+}
+
+void Aprofiler::disable()
+{
+    sEnabled.store(false);
+}
+
+void Aprofiler::reset()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+
+    for (const std::shared_ptr<ThreadData> &data : gThreads) {
+        {
+            std::lock_guard<std::mutex> dataLock(data->mutex);
+            data->index  .clear();
+            data->entries.clear();
+            data->trace  .clear();
+            data->traced = 0;
+        }
+
+        data->seen   .clear();
+        data->history.clear();
+    }
+
+    gEpoch = Clock::now();
+}
+
+std::vector<Aprofiler::Entry> Aprofiler::snapshot()
+{
+    std::map<std::pair<std::string, std::string>, Entry> merged;
+
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+
+        for (const std::shared_ptr<ThreadData> &data : gThreads)
+        {
+            drain(*data);
+
+            for (const Entry &entry : data->seen)
+            {
+                auto const it = merged.emplace(std::make_pair(entry.track, entry.name), entry);
+                if (it.second)
+                    continue;
+
+                Entry &sum = it.first->second;
+                sum.calls   += entry.calls;
+                sum.frames  += entry.frames;
+                sum.seconds += entry.seconds;
+                sum.peak     = std::max(sum.peak, entry.peak);
+            }
+        }
+    }
+
+    std::vector<Entry> result;
+    result.reserve(merged.size());
+
+    for (const auto &it : merged)
+        result.push_back(it.second);
+
+    std::stable_sort(result.begin(), result.end(), [](const Entry &a, const Entry &b) {
+        return a.track != b.track ? a.track < b.track : a.seconds > b.seconds;
+    });
+
+    return result;
+}
+
+bool Aprofiler::write_trace(const std::string &file)
+{
+    std::vector<TraceCopy> threads;
+    Clock::time_point epoch;
+
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+
+        threads.reserve(gThreads.size());
+        epoch = gEpoch;
+
+        for (const std::shared_ptr<ThreadData> &data : gThreads) {
+            drain(*data);
+            threads.push_back({ data->tid, data->seen, data->history });
+        }
+    }
+
+    FILE* const out = fopen(file.c_str(), "w");
+
+    if (out == nullptr) {
+        fprintf(stderr, "libawe [error] Could not open '%s' for writing.\n", file.c_str());
+        return false;
+    }
+
+    fputs("{\"traceEvents\":[", out);
+
+    bool first = true;
+
+    for (const TraceCopy &data : threads)
+    {
+        for (const Event &event : data.events)
+        {
+            const Entry &entry = data.entries[event.entry];
+
+            fputs(first ? "\n" : ",\n", out);
+            first = false;
+
+            fputs("{\"name\":", out);
+            write_json_string(out, entry.name);
+            fprintf(out, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+                    entry.kind == Kind::SOURCE ? "source" : "filter",
+                    to_us(event.start - epoch), to_us(event.end - event.start), data.tid);
+            fputs(",\"args\":{\"track\":", out);
+            write_json_string(out, entry.track);
+            fprintf(out, ",\"frames\":%zu}}", event.frames);
+        }
+    }
+
+    fputs("\n]}\n", out);
+
+    bool const ok = ferror(out) == 0;
+    fclose(out);
+
+    if (ok == false)
+        fprintf(stderr, "libawe [error] Could not write '%s'.\n", file.c_str());
+
+    return ok;
+}
+
+}
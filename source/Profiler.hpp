@@ -0,0 +1,151 @@
+//  Profiler.hpp :: Render time profiler
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_PROFILER_H
+#define AWE_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include "Define.hpp"
+
+namespace awe {
+
+/*! Opt-in render time profiler.
+ *
+ *  When enabled, every \ref Asource::render() call made by a
+ *  \ref awe::Source::Track and every \ref Afilter::filter_buffer() call
+ *  made by a \ref awe::Filter::Rack is timed and counted, together with
+ *  the number of frames it processed. Measurements are aggregated per
+ *  track name and per source or filter object, and can be read through
+ *  \ref snapshot() or dumped as a Chrome trace (`chrome://tracing`)
+ *  through \ref write_trace().
+ *
+ *  While disabled, each instrumented call costs a single relaxed atomic
+ *  load, so the profiler can stay compiled into release builds. While
+ *  enabled, each rendering thread records into its own buffers; a new
+ *  source or filter allocates its entry on first sight, and trace
+ *  events stop being recorded once the per-thread trace buffer is full.
+ *  \ref snapshot() and \ref write_trace() only hold up a rendering
+ *  thread while they copy its counters and swap out its trace buffer;
+ *  merging, formatting and writing are done on the copies.
+ */
+class Aprofiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    //! Kind of a profiled object.
+    enum class Kind : uint8_t
+    {
+        SOURCE  = 0x0,  //!< \ref Asource::render()
+        FILTER  = 0x1   //!< \ref Afilter::filter_buffer()
+    };
+
+    //! Aggregated measurements of one object on one track.
+    struct Entry
+    {
+        std::string track;      //!< Name of the track the object ran on
+        std::string name;       //!< Type and address of the object
+        Kind        kind;       //!< Kind of object
+        uint64_t    calls;      //!< Number of calls
+        uint64_t    frames;     //!< Number of frames processed
+        double      seconds;    //!< Total wall-clock time spent
+        double      peak;       //!< Longest single call, in seconds
+    };
+
+    /*! Scoped timer around one profiled call.
+     *  Does nothing unless the profiler was enabled when it was created.
+     */
+    class Scope
+    {
+    private:
+        const void          * mItem;    //!< Profiled object
+        const std::type_info* mType;    //!< Dynamic type of profiled object, or null if disabled
+        Kind                  mKind;
+        size_t                mFrames;
+        Clock::time_point     mStart;
+
+    public:
+        template< typename T >
+        inline Scope(Kind kind, const T* item, size_t frames)
+            : mItem  (item)
+            , mType  (is_enabled() ? &typeid(*item) : nullptr)
+            , mKind  (kind)
+            , mFrames(frames)
+        {
+            if (mType != nullptr)
+                mStart = Clock::now();
+        }
+
+        inline ~Scope()
+        {
+            if (mType != nullptr)
+                record(mKind, mItem, *mType, mFrames, mStart, Clock::now());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    /*! Scoped track context.
+     *  Attributes the calls profiled on this thread within its lifetime
+     *  to a track.
+     */
+    class TrackScope
+    {
+    private:
+        bool                mActive;
+        const void        * mPrevKey;
+        const std::string * mPrevName;
+
+    public:
+        TrackScope(const void* track, const std::string &name);
+        ~TrackScope();
+
+        TrackScope(const TrackScope&) = delete;
+        TrackScope& operator=(const TrackScope&) = delete;
+    };
+
+private:
+    static std::atomic<bool> sEnabled;
+
+    //! Records one profiled call on the calling thread.
+    static void record(
+            Kind kind, const void* item, const std::type_info &type, size_t frames,
+            Clock::time_point start, Clock::time_point end
+    );
+
+public:
+    //! \return true if the profiler is recording.
+    static inline bool is_enabled() { return sEnabled.load(std::memory_order_relaxed); }
+
+    /*! Starts recording.
+     *  \param trace_events number of trace events each thread keeps for
+     *                      \ref write_trace().
+     */
+    static void enable(size_t trace_events = 65536);
+
+    //! Stops recording. Recorded data is kept until \ref reset().
+    static void disable();
+
+    //! Discards all recorded data.
+    static void reset();
+
+    /*! Retrieves the recorded measurements, merged across threads.
+     *  \return one entry per track name and object, sorted by track name
+     *          and then by total time spent, longest first.
+     */
+    static std::vector<Entry> snapshot();
+
+    /*! Writes the recorded calls as a Chrome trace event JSON file.
+     *  \return false if the file could not be written.
+     */
+    static bool write_trace(const std::string &file);
+};
+
+}
+
+#endif
@@ -0,0 +1,110 @@
+//  RenderGraph.cpp :: Parallel track tree scheduler
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "RenderGraph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace awe {
+
+ArenderGraph::ArenderGraph(Source::Track &root, AthreadPoolPtr pool)
+    : mRoot (root)
+    , mPool (pool)
+    , mNodes()
+    , mEpoch(0)
+    , mBuilt(false)
+    , mGroup(nullptr)
+{
+    assert(mPool && "Invalid pointer to thread pool.");
+}
+
+size_t ArenderGraph::build(Source::Track* track, std::vector<Source::Track*> &path)
+{
+    if (std::find(path.begin(), path.end(), track) != path.end())
+        throw std::runtime_error("libawe [exception] Track '" + track->getName() + "' is attached to itself.");
+
+    // Tracks attached to more than one parent are only added once.
+    for(size_t i = 0; i < mNodes.size(); i++)
+        if (mNodes[i].track == track)
+            return i;
+
+    path.push_back(track);
+
+    std::vector<size_t> children;
+    for(const AsourcePointer &src : track->copy_sources())
+    {
+        Source::Track* child = dynamic_cast<Source::Track*>(src.get());
+        if (child != nullptr)
+            children.push_back(build(child, path));
+    }
+
+    path.pop_back();
+
+    size_t const index = mNodes.size();
+    mNodes.emplace_back(this, track);
+    mNodes[index].children = children.size();
+
+    for(size_t child : children)
+        mNodes[child].parents.push_back(index);
+
+    return index;
+}
+
+void ArenderGraph::rebuild()
+{
+    // Read the epoch first so that changes made while building are not missed.
+    mEpoch = Source::Track::topology_epoch();
+
+    std::vector<Source::Track*> path;
+    mNodes.clear();
+    build(&mRoot, path);
+
+    mBuilt = true;
+}
+
+void ArenderGraph::run_node(void* ptr)
+{
+    Node &node = *static_cast<Node*>(ptr);
+
+    // The root track has no parent to mix its prepared output.
+    if (node.parents.empty()) {
+        node.track->pull();
+        node.track->flip();
+    } else {
+        node.track->prepare();
+    }
+
+    for(size_t p : node.parents)
+    {
+        Node &parent = node.graph->mNodes[p];
+        if (parent.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            node.graph->mPool->submit(*node.graph->mGroup, &ArenderGraph::run_node, &parent);
+    }
+}
+
+void ArenderGraph::update()
+{
+    if (mBuilt == false || mEpoch != Source::Track::topology_epoch())
+        rebuild();
+
+    for(Node &node : mNodes)
+        node.pending.store(node.children, std::memory_order_relaxed);
+
+    ATaskGroup group;
+    mGroup = &group;
+
+    for(Node &node : mNodes)
+        if (node.children == 0)
+            mPool->submit(group, &ArenderGraph::run_node, &node);
+
+    mPool->wait(group);
+    mGroup = nullptr;
+
+    // Every parent has mixed its children by now; the next cycle, graph
+    // or not, pulls them again.
+    for(Node &node : mNodes)
+        node.track->discard_prepared();
+}
+
+}
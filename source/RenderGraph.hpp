@@ -0,0 +1,100 @@
+//  RenderGraph.hpp :: Parallel track tree scheduler
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_RENDERGRAPH_H
+#define AWE_RENDERGRAPH_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Sources/Track.hpp"
+#include "ThreadPool.hpp"
+
+namespace awe {
+
+/*! Render graph scheduler for nested tracks.
+ *
+ *  Tracks are sound sources themselves, so they can be nested into a tree
+ *  of sub-mixes and buses under a root track. Rendering the root track
+ *  normally walks that tree recursively on a single thread.
+ *
+ *  This class flattens the tree under a root track into a dependency
+ *  graph in which every track depends on the tracks attached to it. On
+ *  every \ref update(), tracks without pending dependencies are prepared
+ *  in parallel on a \ref awe::AThreadPool via
+ *  \ref awe::Source::Track::prepare(), and a track is only scheduled once
+ *  all tracks attached to it are done. The parent track then mixes the
+ *  prepared outputs of its child tracks as it pulls its own sources. A
+ *  prepared output stays valid until the end of the update, so a child
+ *  track with several parents, or one mixed over several parts of a
+ *  block split at scheduled events, is only pulled once per block.
+ *
+ *  The graph is rebuilt whenever a source is attached to or detached
+ *  from any track (see \ref awe::Source::Track::topology_epoch()).
+ */
+class ArenderGraph
+{
+    using AsourcePointer = std::shared_ptr< Asource >;
+    using AthreadPoolPtr = std::shared_ptr< AThreadPool >;
+
+private:
+    //! Graph node.
+    struct Node
+    {
+        ArenderGraph        * graph;        //!< Owning graph
+        Source::Track       * track;        //!< Track to prepare
+        std::vector<size_t>   parents;      //!< Nodes depending on this node
+        size_t                children;     //!< Number of nodes this node depends on
+        std::atomic<size_t>   pending;      //!< Number of unfinished dependencies
+
+        Node(ArenderGraph* g, Source::Track* t)
+            : graph(g), track(t), parents(), children(0), pending(0) { }
+
+        Node(Node&& n)
+            : graph(n.graph), track(n.track), parents(std::move(n.parents))
+            , children(n.children), pending(n.pending.load()) { }
+    };
+
+    Source::Track     & mRoot;      //!< Root track
+    AthreadPoolPtr      mPool;      //!< Worker pool
+    std::vector<Node>   mNodes;     //!< Flattened track graph; root is the last node
+    unsigned long       mEpoch;     //!< Topology revision the graph was built from
+    bool                mBuilt;     //!< Has the graph been built?
+    ATaskGroup        * mGroup;     //!< Task group of the running update
+
+    //! Adds a track and all tracks under it to the graph.
+    //! \return index of the track node.
+    size_t build(Source::Track* track, std::vector<Source::Track*> &path);
+
+    //! Prepares the track of a node and schedules its parents.
+    static void run_node(void* node);
+
+public:
+    /*! Render graph constructor.
+     *  \param root root track of the tree to schedule.
+     *  \param pool worker pool to prepare tracks on.
+     */
+    ArenderGraph(Source::Track &root, AthreadPoolPtr pool);
+
+    ArenderGraph(const ArenderGraph&) = delete;
+    ArenderGraph& operator=(const ArenderGraph&) = delete;
+
+    //! Rebuilds the dependency graph from the current track tree.
+    void rebuild();
+
+    /*! Pulls and flips every track in the tree, including the root track,
+     *  rebuilding the graph first if the topology has changed. After this
+     *  call the root track output holds the next block.
+     */
+    void update();
+
+    //! \return number of tracks in the graph.
+    inline size_t size() const { return mNodes.size(); }
+
+    //! \return the worker pool used by this graph.
+    inline AthreadPoolPtr getThreadPool() const { return mPool; }
+};
+
+}
+
+#endif
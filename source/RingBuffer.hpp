@@ -0,0 +1,233 @@
+//  RingBuffer.hpp :: Lock-free single-producer single-consumer ring buffer
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_RINGBUFFER_H
+#define AWE_RINGBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+#include "Define.hpp"
+
+namespace awe {
+
+/*! Wait-free single-producer single-consumer ring buffer.
+ *
+ *  The buffer is allocated once through \ref reset() and never grows, so
+ *  \ref write() and \ref read() neither allocate nor lock. Whole blocks
+ *  are moved with at most two `memcpy` calls each.
+ *
+ *  Exactly one thread may write into the buffer and exactly one other
+ *  thread may read from it. The read and write cursors live on separate
+ *  cache lines so that the two threads do not invalidate each other's
+ *  cache line on every access.
+ *
+ *  \tparam T trivially copyable element type.
+ */
+template< typename T >
+class ARingBuffer
+{
+    static_assert(std::is_trivial<T>::value, "Ring buffer elements must be trivially copyable.");
+
+    static constexpr size_t CacheLine = 64;
+    using Cursor = std::atomic<size_t>;
+
+private:
+    Abuffer<T>  mBuffer;    //!< Preallocated element storage
+    size_t      mMask;      //!< Index mask (capacity - 1)
+
+    char        mPad0[CacheLine];
+    Cursor      mHead;      //!< Write cursor, owned by the producer
+    char        mPad1[CacheLine - sizeof(Cursor)];
+    Cursor      mTail;      //!< Read cursor, owned by the consumer
+    char        mPad2[CacheLine - sizeof(Cursor)];
+
+    Cursor      mOverruns;  //!< Number of writes that did not fit
+    Cursor      mUnderruns; //!< Number of reads that came up short
+    Cursor      mLowWater;  //!< Lowest fill level seen by the consumer
+
+    //! Rounds `v` up to the next power of two.
+    static inline size_t ceil_pow2(size_t v)
+    {
+        size_t p = 1;
+        while (p < v) p <<= 1;
+        return p;
+    }
+
+public:
+    /*! Constructs a ring buffer.
+     *  \param capacity minimum number of elements the buffer can hold.
+     *                  This is rounded up to the next power of two.
+     */
+    ARingBuffer(size_t capacity = 0)
+        : mBuffer   ()
+        , mMask     (0)
+        , mHead     (0)
+        , mTail     (0)
+        , mOverruns (0)
+        , mUnderruns(0)
+        , mLowWater (0)
+    { reset(capacity); }
+
+    ARingBuffer(const ARingBuffer&) = delete;
+    ARingBuffer& operator=(const ARingBuffer&) = delete;
+
+    /*! Reallocates the buffer and resets its state and counters.
+     *  \warning This call is not thread-safe; neither the producer nor
+     *           the consumer may be using the buffer at this time.
+     *  \param capacity minimum number of elements the buffer can hold.
+     */
+    void reset(size_t capacity)
+    {
+        capacity = (capacity == 0) ? 0 : ceil_pow2(capacity);
+
+        mBuffer.assign(capacity, T());
+        mMask = (capacity == 0) ? 0 : capacity - 1;
+
+        mHead.store(0);
+        mTail.store(0);
+
+        reset_counters();
+        mLowWater.store(capacity);
+    }
+
+    //! Resets the overrun, underrun and low-water counters.
+    inline void reset_counters()
+    {
+        mOverruns .store(0, std::memory_order_relaxed);
+        mUnderruns.store(0, std::memory_order_relaxed);
+        mLowWater .store(size(), std::memory_order_relaxed);
+    }
+
+    //!\name Fill level queries
+    //!\{
+
+    //! \return maximum number of elements the buffer can hold.
+    inline size_t capacity() const { return mBuffer.size(); }
+
+    //! \return number of elements ready to be read.
+    inline size_t size() const
+    {
+        // Load the tail first so that the difference never goes negative.
+        size_t const tail = mTail.load(std::memory_order_acquire);
+        size_t const head = mHead.load(std::memory_order_acquire);
+        return std::min(head - tail, capacity());
+    }
+
+    //! \return number of elements that can be written without overrunning.
+    inline size_t space() const { return capacity() - size(); }
+
+    //! \return true if there is nothing to read.
+    inline bool empty() const { return size() == 0; }
+
+    //! \return total number of elements written since the last reset.
+    inline size_t written() const { return mHead.load(std::memory_order_acquire); }
+
+    //! \return number of calls to \ref write() that did not fit entirely.
+    inline size_t overruns () const { return mOverruns .load(std::memory_order_relaxed); }
+
+    //! \return number of calls to \ref read() that did not get all elements.
+    inline size_t underruns() const { return mUnderruns.load(std::memory_order_relaxed); }
+
+    //! \return lowest fill level observed by the consumer since the last reset.
+    inline size_t low_water() const { return mLowWater .load(std::memory_order_relaxed); }
+
+    //!\}
+
+    /*! Writes a block of elements into the buffer.
+     *  \note This must only be called from the producer thread.
+     *  \param[in] src   pointer to elements to write.
+     *  \param[in] count number of elements to write.
+     *  \return number of elements actually written, which is less than
+     *          `count` if the buffer did not have enough space.
+     */
+    size_t write(const T* src, size_t count)
+    {
+        size_t const head = mHead.load(std::memory_order_relaxed);
+        size_t const tail = mTail.load(std::memory_order_acquire);
+        size_t const room = capacity() - (head - tail);
+
+        if (count > room) {
+            mOverruns.fetch_add(1, std::memory_order_relaxed);
+            count = room;
+        }
+
+        if (count == 0)
+            return 0;
+
+        size_t const i = head & mMask;
+        size_t const a = std::min(count, capacity() - i);
+
+        std::memcpy(mBuffer.data() + i, src    , a           * sizeof(T));
+        std::memcpy(mBuffer.data()    , src + a, (count - a) * sizeof(T));
+
+        mHead.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /*! Reads a block of elements out of the buffer.
+     *  \note This must only be called from the consumer thread.
+     *  \param[out] dst   pointer to write the elements into.
+     *  \param[in]  count number of elements to read.
+     *  \return number of elements actually read, which is less than
+     *          `count` if the buffer did not have enough data.
+     */
+    size_t read(T* dst, size_t count)
+    {
+        size_t const tail = mTail.load(std::memory_order_relaxed);
+        size_t const head = mHead.load(std::memory_order_acquire);
+        size_t const fill = head - tail;
+
+        if (count > fill) {
+            mUnderruns.fetch_add(1, std::memory_order_relaxed);
+            count = fill;
+        }
+
+        if (fill - count < mLowWater.load(std::memory_order_relaxed))
+            mLowWater.store(fill - count, std::memory_order_relaxed);
+
+        if (count == 0)
+            return 0;
+
+        size_t const i = tail & mMask;
+        size_t const a = std::min(count, capacity() - i);
+
+        std::memcpy(dst    , mBuffer.data() + i, a           * sizeof(T));
+        std::memcpy(dst + a, mBuffer.data()    , (count - a) * sizeof(T));
+
+        mTail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /*! Discards all readable elements.
+     *  \note This must only be called from the consumer thread.
+     */
+    inline void clear()
+    {
+        mTail.store(mHead.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    /*! Discards all elements written before a given position.
+     *  Positions that have already been read past are ignored.
+     *  \note This must only be called from the consumer thread.
+     *  \param position value of \ref written() to discard up to.
+     */
+    inline void discard(size_t position)
+    {
+        size_t const tail = mTail.load(std::memory_order_relaxed);
+
+        if (position - tail <= capacity())
+            mTail.store(position, std::memory_order_release);
+    }
+};
+
+//!\name Standard ring buffer types
+//!\{
+using AiRingBuffer = ARingBuffer<Aint  >;
+using AfRingBuffer = ARingBuffer<Afloat>;
+//!\}
+
+}
+
+#endif
@@ -5,17 +5,54 @@
 #define AWE_SAMPLE_H
 
 #include <memory>
+#include <string>
+#include "Adpcm.hpp"
 #include "Define.hpp"
 
 namespace awe {
 
 class Asample {
+public:
+    /** Storage format of the audio data.
+     *
+     *  16-bit integer data is normalized against the sample peak and
+     *  converted to floating point as it is rendered. 32-bit floating
+     *  point data keeps the full precision of 24-bit and floating point
+     *  sources, holds values beyond full scale as is, and is fed to the
+     *  mixer and the resampler without any conversion, at twice the
+     *  memory cost. IMA ADPCM data takes a quarter of the memory of
+     *  16-bit data and is decoded block by block as it is played; see
+     *  \ref AadpcmBuffer.
+     */
+    enum class Format : uint8_t
+    {
+        INT16   = 0x0,  //!< Interleaved \ref Aint samples
+        FLOAT32 = 0x1,  //!< Interleaved \ref Afloat samples
+        ADPCM   = 0x2   //!< \ref AadpcmBuffer blocks of 16-bit samples
+    };
+
 private:
     /** Pointer to audio buffer data.
      *  This pointer can be null at creation and be assigned to later.
      */
     std::shared_ptr<AiBuffer> mSource;
 
+    //! Pointer to floating point audio buffer data; see \ref mSource.
+    std::shared_ptr<AfBuffer> mFloatSource;
+
+    //! Pointer to compressed audio buffer data; see \ref mSource.
+    std::shared_ptr<const AadpcmBuffer> mCompressed;
+
+    /** Pointer to the memory backing the audio data.
+     *  This is either \ref mSource or a memory-mapped file, and keeps the
+     *  memory behind \ref mData alive.
+     */
+    std::shared_ptr<const void> mStorage;
+
+    const void    * mData;          //!< Pointer to the interleaved audio data.
+    size_t          mLength;        //!< Number of samples pointed to by mData.
+    Format          mFormat;        //!< Format of the samples pointed to by mData.
+
     Achan           mChannels;      //!< Number of channels on the source buffer.
 
     /** Audio buffer data peak gain applied before being sent to mixer.
@@ -31,7 +68,7 @@ private:
     std::string     mSampleName;    //!< Descriptive name of the sample.
 
 public:
-    Asample() : mSource(nullptr), mChannels(0), mSourcePeak(1.0f), mSampleRate(0), mSampleName("null") { }
+    Asample() : mSource(nullptr), mFloatSource(nullptr), mCompressed(nullptr), mStorage(nullptr), mData(nullptr), mLength(0), mFormat(Format::INT16), mChannels(0), mSourcePeak(1.0f), mSampleRate(0), mSampleName("null") { }
 
     /** Default constructor
      *
@@ -46,31 +83,113 @@ public:
             const unsigned long &_rate,
             const std::string   &_name = "Unnamed sample"
     )   : mSource       (_source)
+        , mFloatSource  (nullptr)
+        , mCompressed   (nullptr)
+        , mStorage      (_source)
+        , mData         (_source ? _source->data() : nullptr)
+        , mLength       (_source ? _source->size() : 0)
+        , mFormat       (Format::INT16)
         , mChannels     (_chan)
         , mSourcePeak   (_peak)
         , mSampleRate   (_rate)
         , mSampleName   (_name)
     { }
 
+    /** Floating point buffer constructor
+     *
+     *  \param _source Floating point audio buffer source.
+     *  \param _chan   Number of interleaved channels in the buffer.
+     *  \param _rate   Audio buffer source sample rate.
+     *  \param _name   Audio buffer name. (Not used by this class)
+     */
+    Asample(std::shared_ptr<AfBuffer> &_source,
+            const Achan         &_chan,
+            const unsigned long &_rate,
+            const std::string   &_name = "Unnamed sample"
+    )   : mSource       (nullptr)
+        , mFloatSource  (_source)
+        , mCompressed   (nullptr)
+        , mStorage      (_source)
+        , mData         (_source ? _source->data() : nullptr)
+        , mLength       (_source ? _source->size() : 0)
+        , mFormat       (Format::FLOAT32)
+        , mChannels     (_chan)
+        , mSourcePeak   (1.0f)
+        , mSampleRate   (_rate)
+        , mSampleName   (_name)
+    { }
+
     /** Load from file constructor.
+     *
+     *  \param file   path to the sound file.
+     *  \param format format to store the decoded audio data in.
      *
      *  \warning This function blocks execution and leaves source as
      *           `nullptr` if it fails to load the sample from file.
      */
-    Asample(const std::string &file);
+    Asample(const std::string &file, Format format = Format::INT16);
 
     /** Load from memory constructor.
      *
      *  \warning This function blocks execution and leaves source as
      *           `nullptr` if it fails to load the sample from memory.
      */
-    Asample(char* mptr, const size_t &size, const std::string &_name = "Unnamed sample");
+    Asample(char* mptr, const size_t &size, const std::string &_name = "Unnamed sample", Format format = Format::INT16);
+
+    /** Memory-mapped load function for 16-bit PCM and 32-bit floating
+     *  point WAV files.
+     *
+     *  The audio data is not decoded or copied; the sample points straight
+     *  into the read-only mapped pages of the file, which are paged in on
+     *  first use and shared with every other process mapping the same
+     *  file. The peak compensation multiplier is always 1.0, and the
+     *  storage format is that of the file.
+     *
+     *  \warning This function returns `nullptr` without printing an error
+     *           if the file is not a 16-bit PCM or 32-bit floating point
+     *           WAV file of at most \ref MAX_CHANNELS channels.
+     *           Use \ref open() to fall back onto decoding such files.
+     */
+    static std::shared_ptr<Asample> map(const std::string &file);
+
+    /** Memory-mapped load function for headerless 16-bit PCM files.
+     *
+     *  \param file   path to the raw file.
+     *  \param chan   number of interleaved channels in the file.
+     *  \param rate   sampling rate of the audio data.
+     *  \param offset number of bytes to skip at the start of the file.
+     *                This must be a multiple of two.
+     *  \return `nullptr` if the file cannot be mapped.
+     */
+    static std::shared_ptr<Asample> map_raw(
+            const std::string &file,
+            Achan              chan,
+            unsigned long      rate,
+            size_t             offset = 0
+    );
+
+    /** Load function that memory-maps the file through \ref map() if
+     *  possible and decodes it into memory otherwise.
+     *
+     *  \param file   path to the sound file.
+     *  \param format format to store decoded audio data in. Mapped files
+     *                keep their own format.
+     *
+     *  \warning Like the load from file constructor, the returned sample
+     *           has no data if the file could not be loaded at all.
+     */
+    static std::shared_ptr<Asample> open(const std::string &file, Format format = Format::INT16);
 
     virtual ~Asample() { }
 
     inline bool drop() {
-        if (mSource) {
-            mSource.reset();
+        if (mStorage) {
+            mSource     .reset();
+            mFloatSource.reset();
+            mCompressed .reset();
+            mStorage    .reset();
+            mData   = nullptr;
+            mLength = 0;
             return true;
         } else {
             return false;
@@ -84,15 +203,147 @@ public:
      */
     inline void setSource(std::shared_ptr<AiBuffer> _source, Afloat _peak)
     {
-        mSource     = _source;
-        mSourcePeak = _peak;
+        mSource      = _source;
+        mFloatSource = nullptr;
+        mCompressed  = nullptr;
+        mStorage     = _source;
+        mData        = _source ? _source->data() : nullptr;
+        mLength      = _source ? _source->size() : 0;
+        mFormat      = Format::INT16;
+        mSourcePeak  = _peak;
     }
 
+    /** Assigns a floating point audio buffer to the sample.
+     *  The peak compensation multiplier is reset to 1.0.
+     *
+     *  \param _source Floating point audio buffer source.
+     */
+    inline void setSource(std::shared_ptr<AfBuffer> _source)
+    {
+        mSource      = nullptr;
+        mFloatSource = _source;
+        mCompressed  = nullptr;
+        mStorage     = _source;
+        mData        = _source ? _source->data() : nullptr;
+        mLength      = _source ? _source->size() : 0;
+        mFormat      = Format::FLOAT32;
+        mSourcePeak  = 1.0f;
+    }
+
+    /** Assigns externally owned audio data to the sample.
+     *
+     *  \param _storage Object keeping the audio data alive.
+     *  \param _data    Pointer to the interleaved audio data.
+     *  \param _length  Number of samples (not frames) in the audio data.
+     *  \param _peak    Audio buffer peak compensation multiplier.
+     */
+    inline void setSource(std::shared_ptr<const void> _storage, const Aint* _data, size_t _length, Afloat _peak)
+    {
+        mSource      = nullptr;
+        mFloatSource = nullptr;
+        mCompressed  = nullptr;
+        mStorage     = _storage;
+        mData        = _data;
+        mLength      = _length;
+        mFormat      = Format::INT16;
+        mSourcePeak  = _peak;
+    }
+
+    /** Assigns externally owned floating point audio data to the sample.
+     *  The peak compensation multiplier is reset to 1.0.
+     *
+     *  \param _storage Object keeping the audio data alive.
+     *  \param _data    Pointer to the interleaved audio data.
+     *  \param _length  Number of samples (not frames) in the audio data.
+     */
+    inline void setSource(std::shared_ptr<const void> _storage, const Afloat* _data, size_t _length)
+    {
+        mSource      = nullptr;
+        mFloatSource = nullptr;
+        mCompressed  = nullptr;
+        mStorage     = _storage;
+        mData        = _data;
+        mLength      = _length;
+        mFormat      = Format::FLOAT32;
+        mSourcePeak  = 1.0f;
+    }
+
+    /** Assigns compressed audio data to the sample.
+     *
+     *  \param _source Compressed audio data. Its channel count must match
+     *                 that of the sample.
+     *  \param _peak   Audio buffer peak compensation multiplier.
+     */
+    inline void setSource(std::shared_ptr<const AadpcmBuffer> _source, Afloat _peak)
+    {
+        mSource      = nullptr;
+        mFloatSource = nullptr;
+        mCompressed  = _source;
+        mStorage     = _source;
+        mData        = _source ? _source->data() : nullptr;
+        mLength      = _source ? _source->getFrameCount() * _source->getChannelCount() : 0;
+        mFormat      = Format::ADPCM;
+        mSourcePeak  = _peak;
+    }
+
+    /** Compresses the audio data of a 16-bit sample in place.
+     *  \warning The sample must not be playing, as its data is replaced.
+     *  \param block_frames number of frames per compressed block.
+     *  \return false if the sample has no data or is not stored as
+     *          \ref Format::INT16.
+     */
+    bool compress(size_t block_frames = AadpcmBuffer::DEFAULT_BLOCK_FRAMES);
+
     inline std::shared_ptr<const AiBuffer> cgetSource() const { return mSource; }
     inline std::shared_ptr<      AiBuffer>  getSource()       { return mSource; }
 
+    inline std::shared_ptr<const AfBuffer> cgetFloatSource() const { return mFloatSource; }
+    inline std::shared_ptr<      AfBuffer>  getFloatSource()       { return mFloatSource; }
+
+    //! \return compressed audio data, for samples stored as \ref Format::ADPCM.
+    inline std::shared_ptr<const AadpcmBuffer> getCompressed() const { return mCompressed; }
+
+    //! \return object keeping the memory behind \ref getData() alive.
+    inline std::shared_ptr<const void>     getStorage() const { return mStorage; }
+
+    /** \return pointer to the interleaved 16-bit audio data, or `nullptr`
+     *          if the sample has no data or is not stored as
+     *          \ref Format::INT16. Unlike \ref getSource(), this also
+     *          works for memory-mapped samples.
+     */
+    inline const Aint  * getData        () const { return mFormat == Format::INT16   ? static_cast<const Aint  *>(mData) : nullptr; }
+
+    //! \return like \ref getData(), for samples stored as \ref Format::FLOAT32.
+    inline const Afloat* getFloatData   () const { return mFormat == Format::FLOAT32 ? static_cast<const Afloat*>(mData) : nullptr; }
+
+    /** \return pointer to the audio data in any format. This is the
+     *          interleaved samples of uncompressed formats and the first
+     *          encoded block of compressed formats.
+     */
+    inline const void  * getRawData     () const { return mData; }
+
+    //! \return number of samples (not frames) in the audio data.
+    inline size_t        getDataSize    () const { return mLength; }
+    inline Format        getFormat      () const { return mFormat; }
+    inline bool          has_data       () const { return mData != nullptr; }
+    inline bool          is_mapped      () const { return mData != nullptr && !mSource && !mFloatSource && !mCompressed; }
+
+    //! \return size of a single sample value in bytes, or 0 for compressed formats.
+    inline size_t        getSampleSize  () const
+    {
+        switch (mFormat)
+        {
+        case Format::INT16:   return sizeof(Aint);
+        case Format::FLOAT32: return sizeof(Afloat);
+        default:              return 0;
+        }
+    }
+
+    //! \return size of the audio data in memory, in bytes.
+    inline size_t        getDataBytes   () const { return mCompressed ? mCompressed->size() : mLength * getSampleSize(); }
+
     inline Achan         getChannelCount() const { return mChannels; }
-    inline size_t        getFrameCount  () const { return mSource->size() / mChannels; }
+    inline size_t        getFrameCount  () const { return mLength / mChannels; }
     inline Afloat        getPeak        () const { return mSourcePeak; }
     inline unsigned long getSampleRate  () const { return mSampleRate; }
     inline std::string   getSampleName  () const { return mSampleName; }
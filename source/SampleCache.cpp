@@ -0,0 +1,197 @@
+//  SampleCache.cpp :: Budgeted sound sample cache
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "SampleCache.hpp"
+
+#include <cstdio>
+
+namespace awe {
+
+//! 64-bit FNV-1a hash of a memory block.
+static uint64_t fnv1a(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+AsampleCache::AsampleCache(size_t budget)
+    : mMutex    ()
+    , mEntries  ()
+    , mUsage    ()
+    , mBudget   (budget)
+    , mResident (0)
+    , mHits     (0)
+    , mMisses   (0)
+    , mEvictions(0)
+{ }
+
+AsampleCache::SamplePtr AsampleCache::find(const std::string &key)
+{
+    auto const it = mEntries.find(key);
+    if (it == mEntries.end())
+        return nullptr;
+
+    mUsage.splice(mUsage.begin(), mUsage, it->second.usage);
+    return it->second.sample;
+}
+
+AsampleCache::SamplePtr AsampleCache::insert(const std::string &key, const SamplePtr &sample)
+{
+    if (sample->has_data() == false)
+        return sample;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Another thread may have loaded the same sample in the meantime.
+    SamplePtr const cached = find(key);
+    if (cached)
+        return cached;
+
+    mUsage.push_front(key);
+
+    Entry entry;
+    entry.sample = sample;
+    entry.bytes  = sample->getDataBytes();
+    entry.usage  = mUsage.begin();
+
+    mEntries.emplace(key, entry);
+    mResident += entry.bytes;
+
+    evict();
+    return sample;
+}
+
+void AsampleCache::evict()
+{
+    auto it = mUsage.end();
+
+    while (mResident > mBudget && it != mUsage.begin())
+    {
+        --it;
+        Entry &entry = mEntries.at(*it);
+
+        // Still in use by a sampler or the application.
+        if (entry.sample.use_count() > 1)
+            continue;
+
+        mResident  -= entry.bytes;
+        mEvictions += 1;
+
+        mEntries.erase(*it);
+        it = mUsage.erase(it);
+    }
+}
+
+AsampleCache::SamplePtr AsampleCache::load(const std::string &file)
+{
+    std::string const key = "file:" + file;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        SamplePtr const cached = find(key);
+        if (cached) {
+            mHits += 1;
+            return cached;
+        }
+
+        mMisses += 1;
+    }
+
+    return insert(key, Asample::open(file));
+}
+
+AsampleCache::SamplePtr AsampleCache::load(char* mptr, size_t size, const std::string &name)
+{
+    char key[48];
+    snprintf(key, sizeof(key), "data:%016llx:%zu", static_cast<unsigned long long>(fnv1a(mptr, size)), size);
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        SamplePtr const cached = find(key);
+        if (cached) {
+            mHits += 1;
+            return cached;
+        }
+
+        mMisses += 1;
+    }
+
+    return insert(key, std::make_shared<Asample>(mptr, size, name));
+}
+
+void AsampleCache::trim()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    evict();
+}
+
+void AsampleCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    size_t const budget = mBudget;
+    mBudget = 0;
+    evict();
+    mBudget = budget;
+}
+
+void AsampleCache::setBudget(size_t budget)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBudget = budget;
+    evict();
+}
+
+size_t AsampleCache::getBudget() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBudget;
+}
+
+size_t AsampleCache::getResident() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mResident;
+}
+
+size_t AsampleCache::getCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEntries.size();
+}
+
+size_t AsampleCache::getHits() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHits;
+}
+
+size_t AsampleCache::getMisses() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMisses;
+}
+
+size_t AsampleCache::getEvictions() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEvictions;
+}
+
+void AsampleCache::reset_stats()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHits      = 0;
+    mMisses    = 0;
+    mEvictions = 0;
+}
+
+}
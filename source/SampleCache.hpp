@@ -0,0 +1,116 @@
+//  SampleCache.hpp :: Budgeted sound sample cache
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_SAMPLECACHE_H
+#define AWE_SAMPLECACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Sample.hpp"
+
+namespace awe {
+
+/*! Sound sample cache with a memory budget.
+ *
+ *  Samples are keyed by file path, or by a hash of their contents when
+ *  loaded from memory, so loading the same sample twice returns the
+ *  same \ref Asample object.
+ *
+ *  Once the audio data held by the cache goes over its byte budget,
+ *  samples are evicted least recently used first. A sample is only
+ *  evicted while nothing outside of the cache, such as a
+ *  \ref awe::Source::Sampler, holds a reference to it; an evicted
+ *  sample is simply loaded again the next time it is requested. Since
+ *  samples may be released at any time, call \ref trim() periodically
+ *  to enforce the budget between loads.
+ *
+ *  All functions are thread-safe. Samples are loaded outside of the
+ *  cache lock.
+ */
+class AsampleCache
+{
+public:
+    using SamplePtr = std::shared_ptr<Asample>;
+
+private:
+    using KeyList = std::list<std::string>;
+
+    //! Cached sample.
+    struct Entry
+    {
+        SamplePtr           sample; //!< Cached sample
+        size_t              bytes;  //!< Size of audio data
+        KeyList::iterator   usage;  //!< Position in mUsage
+    };
+
+    mutable std::mutex      mMutex;
+    std::unordered_map<std::string, Entry>
+                            mEntries;   //!< Cached samples by key
+    KeyList                 mUsage;     //!< Keys, most recently used first
+
+    size_t                  mBudget;    //!< Maximum size of audio data to keep
+    size_t                  mResident;  //!< Size of audio data in cache
+
+    size_t                  mHits;      //!< Number of requests served from cache
+    size_t                  mMisses;    //!< Number of requests that had to load
+    size_t                  mEvictions; //!< Number of samples evicted
+
+    //! Looks up a key and marks it as used. Must be called locked.
+    SamplePtr find(const std::string &key);
+
+    //! Adds a freshly loaded sample. \return the sample to hand out.
+    SamplePtr insert(const std::string &key, const SamplePtr &sample);
+
+    //! Evicts unreferenced samples down to the budget. Must be called locked.
+    void evict();
+
+public:
+    /*! Constructs an empty cache.
+     *  \param budget maximum number of bytes of audio data to keep.
+     */
+    AsampleCache(size_t budget = 256 << 20);
+
+    AsampleCache(const AsampleCache&) = delete;
+    AsampleCache& operator=(const AsampleCache&) = delete;
+
+    /*! Returns the cached sample for a file, loading it through
+     *  \ref Asample::open() if it is not cached.
+     *  \warning Samples that fail to load are returned without data and
+     *           are not cached.
+     */
+    SamplePtr load(const std::string &file);
+
+    /*! Returns the cached sample for a memory blob, loading it if no
+     *  sample with the same contents is cached.
+     *  \warning Samples that fail to load are returned without data and
+     *           are not cached.
+     */
+    SamplePtr load(char* mptr, size_t size, const std::string &name = "Unnamed sample");
+
+    //! Evicts unreferenced samples until the cache is within its budget.
+    void trim();
+
+    //! Evicts all unreferenced samples.
+    void clear();
+
+    //! Changes the budget and trims the cache to it.
+    void setBudget(size_t budget);
+
+    //!\name Cache statistics
+    //!\{
+    size_t getBudget    () const;   //!< \return maximum size of audio data in bytes.
+    size_t getResident  () const;   //!< \return size of cached audio data in bytes.
+    size_t getCount     () const;   //!< \return number of cached samples.
+    size_t getHits      () const;   //!< \return number of requests served from cache.
+    size_t getMisses    () const;   //!< \return number of requests that loaded a sample.
+    size_t getEvictions () const;   //!< \return number of samples evicted.
+    void   reset_stats  ();         //!< Resets the hit, miss and eviction counters.
+    //!\}
+};
+
+}
+
+#endif
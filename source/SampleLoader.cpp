@@ -0,0 +1,126 @@
+//  SampleLoader.cpp :: Asynchronous sample bank loader
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "SampleLoader.hpp"
+
+#include <algorithm>
+
+namespace awe {
+
+AsampleLoader::AsampleLoader(const std::shared_ptr<AThreadPool> &pool)
+    : mPool     (pool)
+    , mGroup    ()
+    , mMutex    ()
+    , mBacklog  ()
+    , mInFlight (0)
+    , mLimit    (std::max<size_t>(1, pool->size() * 2))
+    , mPending  (0)
+{ }
+
+AsampleLoader::~AsampleLoader()
+{
+    wait();
+}
+
+void AsampleLoader::load_task(void* data)
+{
+    Job* const job = static_cast<Job*>(data);
+    AsampleLoader* const loader = job->loader;
+
+    try {
+        if (job->mptr == nullptr)
+            job->promise.set_value(Asample::open(job->name));
+        else
+            job->promise.set_value(std::make_shared<Asample>(job->mptr, job->size, job->name));
+    } catch (...) {
+        job->promise.set_exception(std::current_exception());
+    }
+
+    delete job;
+
+    {
+        std::lock_guard<std::mutex> lock(loader->mMutex);
+        loader->mInFlight -= 1;
+    }
+
+    loader->dispatch();
+
+    // The group counter is released by the pool after this returns, so
+    // wait() does not let the loader go away before then.
+    loader->mPending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void AsampleLoader::dispatch()
+{
+    while (true)
+    {
+        Job* job = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mBacklog.empty() || mInFlight >= mLimit)
+                return;
+
+            job = mBacklog.front();
+            mBacklog.pop_front();
+            mInFlight += 1;
+        }
+
+        mPool->submit(mGroup, load_task, job);
+    }
+}
+
+AsampleLoader::Handle AsampleLoader::enqueue(Job* job)
+{
+    job->loader = this;
+    Handle const handle = job->promise.get_future().share();
+
+    mPending.fetch_add(1, std::memory_order_acq_rel);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBacklog.push_back(job);
+    }
+
+    dispatch();
+    return handle;
+}
+
+AsampleLoader::Handle AsampleLoader::load(const std::string &file)
+{
+    Job* const job = new Job();
+    job->name = file;
+    job->mptr = nullptr;
+    job->size = 0;
+    return enqueue(job);
+}
+
+AsampleLoader::Handle AsampleLoader::load(char* mptr, size_t size, const std::string &name)
+{
+    Job* const job = new Job();
+    job->name = name;
+    job->mptr = mptr;
+    job->size = size;
+    return enqueue(job);
+}
+
+std::vector<AsampleLoader::Handle> AsampleLoader::load(const std::vector<std::string> &files)
+{
+    std::vector<Handle> handles;
+    handles.reserve(files.size());
+
+    for (const std::string &file : files)
+        handles.push_back(load(file));
+
+    return handles;
+}
+
+void AsampleLoader::wait()
+{
+    // Help out with the loads that are already on the pool; the last
+    // load to finish dispatches the next one from the backlog.
+    do {
+        mPool->wait(mGroup);
+    } while (pending() != 0 || mGroup.done() == false);
+}
+
+}
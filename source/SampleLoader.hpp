@@ -0,0 +1,112 @@
+//  SampleLoader.hpp :: Asynchronous sample bank loader
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_SAMPLELOADER_H
+#define AWE_SAMPLELOADER_H
+
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Sample.hpp"
+#include "ThreadPool.hpp"
+
+namespace awe {
+
+/*! Loads sound samples in parallel on a worker thread pool.
+ *
+ *  Every call to \ref load() returns a handle right away, which becomes
+ *  ready as soon as that one sample has been loaded, independently of
+ *  the rest of the bank. Samples are loaded in the order they were
+ *  requested, so an application can start playing the first samples of
+ *  a bank while the remaining ones are still being decoded.
+ *
+ *  Files are loaded through \ref Asample::open(), so 16-bit PCM WAV
+ *  files are memory-mapped instead of decoded. A sample that fails to
+ *  load is still handed out, without any data, just like with the
+ *  \ref Asample constructors.
+ *
+ *  At most two loads per worker are queued on the pool at any time; the
+ *  rest wait in this loader so that audio tasks sharing the pool are
+ *  not starved.
+ */
+class AsampleLoader
+{
+public:
+    using SamplePtr = std::shared_ptr<Asample>;
+    using Handle    = std::shared_future<SamplePtr>;
+
+private:
+    //! Pending load request.
+    struct Job
+    {
+        AsampleLoader         * loader;     //!< Owning loader
+        std::promise<SamplePtr> promise;    //!< Result of the load
+        std::string             name;       //!< File path or sample name
+        char                  * mptr;       //!< Memory blob, or null to load a file
+        size_t                  size;       //!< Size of memory blob
+    };
+
+    std::shared_ptr<AThreadPool>    mPool;      //!< Pool to load samples on
+    ATaskGroup                      mGroup;     //!< Group of submitted loads
+
+    std::mutex                      mMutex;     //!< Protects mBacklog and mInFlight
+    std::deque< Job* >              mBacklog;   //!< Loads not submitted yet
+    size_t                          mInFlight;  //!< Loads submitted to the pool
+    size_t                          mLimit;     //!< Maximum number of loads in flight
+
+    std::atomic<size_t>             mPending;   //!< Loads not finished yet
+
+    //! Queues a job and submits as many backlogged jobs as allowed.
+    Handle enqueue(Job* job);
+
+    //! Submits backlogged jobs until the in-flight limit is reached.
+    void dispatch();
+
+    //! Pool task that loads one sample.
+    static void load_task(void* data);
+
+public:
+    /*! Constructs a loader.
+     *  \param pool worker thread pool to load samples on. This may be
+     *              shared with \ref awe::AEngine::setThreadPool(); the
+     *              render thread only runs its own tasks while waiting,
+     *              never a load.
+     */
+    AsampleLoader(const std::shared_ptr<AThreadPool> &pool);
+
+    //! Waits for all requested samples to finish loading.
+    ~AsampleLoader();
+
+    AsampleLoader(const AsampleLoader&) = delete;
+    AsampleLoader& operator=(const AsampleLoader&) = delete;
+
+    /*! Requests a sample to be loaded from a file.
+     *  \return handle to the loaded sample.
+     */
+    Handle load(const std::string &file);
+
+    /*! Requests a sample to be loaded from memory.
+     *  \warning The memory block must stay valid until the handle is ready.
+     *  \return handle to the loaded sample.
+     */
+    Handle load(char* mptr, size_t size, const std::string &name = "Unnamed sample");
+
+    /*! Requests a list of samples to be loaded from files.
+     *  \return handles to the loaded samples, in the same order.
+     */
+    std::vector<Handle> load(const std::vector<std::string> &files);
+
+    //! Waits for all requested samples to finish loading.
+    void wait();
+
+    //! \return number of requested samples that have not finished loading.
+    inline size_t pending() const { return mPending.load(std::memory_order_acquire); }
+};
+
+}
+
+#endif
@@ -27,12 +27,50 @@ public:
      */
     virtual void make_active (void* userData = nullptr) = 0;
 
+    /*! Prepares the sound source for rendering with a configuration.
+     *
+     *  Sound source managers, such as \ref awe::Source::Track, call this
+     *  when the source is attached and whenever their render
+     *  configuration changes, outside of the render path. Sources should
+     *  allocate any working memory needed to render
+     *  `targetConfig.frameCount` frames here so that \ref render() does
+     *  not have to.
+     *
+     *  \param[in] targetConfig output configuration structure
+     */
+    virtual void configure (const ArenderConfig &targetConfig) { (void) targetConfig; }
+
+    /*! Sets the channel volumes of the sound source.
+     *
+     *  This may be called between two \ref render() calls on the render
+     *  thread by \ref awe::Source::Track::schedule_gain(), so it must
+     *  follow the same real-time contract.
+     *
+     *  \param left  new left channel volume.
+     *  \param right new right channel volume.
+     *  \return false if this source does not have adjustable volumes.
+     */
+    virtual bool set_gain (Afloat left, Afloat right) { (void) left; (void) right; return false; }
+
     /*! Queries the activity state of the sound source.
      *  \return true if this source source is up and running.
      */
     virtual bool is_active () const = 0;
 
     /*! Function to render data from the sound source into a buffer.
+     *
+     *  The source should add `targetConfig.frameCount` frames of audio
+     *  onto the target buffer, starting from frame
+     *  `targetConfig.frameOffset`.
+     *
+     *  \par Real-time contract
+     *  This function may be called from the audio device callback (see
+     *  \ref awe::AEngine::Mode::PULL). Implementations must not allocate
+     *  or free memory, wait on locks held by other threads, perform I/O
+     *  or otherwise block once the source has been made active. Any
+     *  working memory must be set up beforehand, e.g. in the constructor
+     *  or \ref make_active().
+     *
      *  \param[in,out]  targetBuffer target to render sound into
      *  \param[in]      targetConfig output configuration structure
      */
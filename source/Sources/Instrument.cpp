@@ -0,0 +1,466 @@
+//  Instrument.cpp :: Polyphonic sampler instrument
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "Instrument.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "../AllocGuard.hpp"
+#include "../Kernels.hpp"
+#include "../soxr-0.1.1/src/soxr.h"
+#include "Sampler.hpp"
+
+namespace awe {
+namespace Source {
+
+//! Maximum number of frames a voice resampler reads ahead.
+static constexpr size_t VoiceInputFrames = 256;
+
+//! Distance between frames probed for the output level of a voice.
+static constexpr size_t LevelStride = 16;
+
+size_t Instrument::Voice::input_fn(void* data, const void** buffer, size_t frames)
+{
+    Voice* const v = static_cast<Voice*>(data);
+
+    frames = std::min(frames, VoiceInputFrames);
+
+    // Feed silence past the end of the sample instead of ending the
+    // input, so that the resampler never flushes and can be reused.
+    if (v->read >= v->size) {
+        *buffer = v->silence;
+        return frames;
+    }
+
+    frames  = std::min(frames, v->size - v->read);
+    *buffer = v->compressed ? static_cast<const void*>(v->reader.fetch(v->read, frames))
+                            : static_cast<const void*>(v->data + v->read * v->step);
+    v->read += frames;
+    return frames;
+}
+
+Instrument::Instrument(
+    const std::vector<SamplePtr> &bank,
+    unsigned long output_sample_rate,
+    size_t voices,
+    Steal steal,
+    size_t frames
+)   : mBank             (bank)
+    , mOutputSampleRate (output_sample_rate)
+    , mInputSampleRate  (0)
+    , mChannels         (0)
+    , mFormat           (Asample::Format::INT16)
+    , mSteal            (steal)
+    , mVoices           ()
+    , mFree             ()
+    , mOldest           (NoVoice)
+    , mNewest           (NoVoice)
+    , mEvents           (std::max<size_t>(64, voices * 4))
+    , mSilence          ()
+    , mScratch          ()
+    , mActive           (true)
+    , mPlaying          (0)
+    , mDraining         (0)
+    , mSteals           (0)
+    , mDropped          (0)
+{
+    const AadpcmBuffer* largest = nullptr;
+
+    for (const SamplePtr &sample : mBank) {
+        if (!sample || sample->has_data() == false)
+            continue;
+
+        const AadpcmBuffer* const compressed = sample->getCompressed().get();
+        if (compressed && (!largest || compressed->getBlockFrames() > largest->getBlockFrames()))
+            largest = compressed;
+
+        if (mChannels == 0) {
+            mChannels        = sample->getChannelCount();
+            mInputSampleRate = sample->getSampleRate();
+            mFormat          = sample->getFormat();
+        } else if (sample->getChannelCount() != mChannels || sample->getSampleRate() != mInputSampleRate || sample->getFormat() != mFormat) {
+            throw std::runtime_error("libawe [exception] Sample '" + sample->getName() + "' does not match the format of the instrument bank.");
+        }
+    }
+
+    if (mChannels == 0)
+        throw std::runtime_error("libawe [exception] Instrument bank has no playable samples.");
+
+    voices = std::max<size_t>(voices, 1);
+
+    mSilence.assign(VoiceInputFrames * mChannels, 0.0f);
+    mScratch.assign(frames           * mChannels, 0.0f);
+
+    mVoices  .resize(voices);
+    mFree    .reserve(voices);
+    mFlushing.reserve(voices);
+
+    for (size_t i = 0; i < voices; i++)
+    {
+        Voice &v = mVoices[i];
+        v.soxr       = nullptr;
+        v.data       = nullptr;
+        v.silence    = mSilence.data();
+        v.step       = mChannels * (mFormat == Asample::Format::FLOAT32 ? sizeof(Afloat) : sizeof(Aint));
+        v.compressed = mFormat == Asample::Format::ADPCM;
+        v.size       = 0;
+        v.read       = 0;
+        v.remaining  = 0;
+        v.older      = NoVoice;
+        v.newer      = NoVoice;
+        v.drain      = 0;
+        v.flushes    = 0;
+        v.gainL      = 0.0f;
+        v.gainR      = 0.0f;
+        v.level      = 0.0f;
+        v.active     = false;
+
+        // Size the decoder for the largest block in the bank up front.
+        if (largest != nullptr)
+            v.reader.reset(largest);
+
+        // Free voices are handed out in ascending order.
+        mFree.push_back(voices - 1 - i);
+
+        // !workaround See TODO in Sampler's SoXR::SoXR
+        if (mInputSampleRate == mOutputSampleRate)
+            continue;
+
+        soxr_error_t              error  = nullptr;
+        soxr_datatype_t     const soxIn  = mFormat == Asample::Format::FLOAT32 ? SOXR_FLOAT32_I : SOXR_INT16_I;
+        soxr_io_spec_t      const soxIOs = soxr_io_spec(soxIn, SOXR_FLOAT32_I);
+        soxr_quality_spec_t const soxQs  = soxr_quality_spec(SOXR_MQ, 0);
+        soxr_runtime_spec_t const soxRTs = soxr_runtime_spec(SoXR_threads);
+
+        v.soxr = soxr_create(
+                static_cast<double>  (mInputSampleRate),    // Input rate
+                static_cast<double>  (mOutputSampleRate),   // Output rate
+                static_cast<unsigned>(mChannels),           // Channel Count
+                &error, &soxIOs, &soxQs, &soxRTs
+                );
+        if (error) { throw std::runtime_error(error); }
+
+        error = soxr_set_input_fn(v.soxr, (soxr_input_fn_t) Voice::input_fn, &v, VoiceInputFrames);
+        if (error) { throw std::runtime_error(error); }
+    }
+}
+
+Instrument::~Instrument()
+{
+    for (Voice &v : mVoices)
+        if (v.soxr != nullptr)
+            soxr_delete(v.soxr);
+}
+
+void Instrument::drop() {
+    mActive.store(false);
+}
+
+void Instrument::configure(const ArenderConfig& config) {
+    if (mScratch.size() < config.frameCount * mChannels)
+        mScratch.resize(config.frameCount * mChannels);
+}
+
+void Instrument::make_active(void*) {
+    mActive.store(true);
+}
+
+bool Instrument::is_active() const {
+    // Nothing to render until the next trigger; tracks keep polling.
+    return mActive.load()
+        && (mPlaying .load(std::memory_order_relaxed) != 0
+        ||  mDraining.load(std::memory_order_relaxed) != 0
+        ||  mEvents.empty() == false);
+}
+
+bool Instrument::trigger(size_t index, Asfloatf gain)
+{
+    if (index >= mBank.size() || !mBank[index] || mBank[index]->has_data() == false)
+        return false;
+
+    Event const event = { static_cast<uint32_t>(index), gain[0], gain[1] };
+
+    if (mEvents.write(&event, 1) == 0) {
+        mDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+bool Instrument::silence()
+{
+    Event const event = { SilenceEvent, 0.0f, 0.0f };
+    return mEvents.write(&event, 1) == 1;
+}
+
+void Instrument::start(const Event &event)
+{
+    size_t index;
+
+    if (mFree.empty() == false) {
+        index = mFree.back();
+        mFree.pop_back();
+        mPlaying.fetch_add(1, std::memory_order_relaxed);
+    } else if (mFlushing.empty() == false) {
+        // Finish flushing a silenced voice rather than steal a playing one.
+        index = mFlushing.back();
+        mFlushing.pop_back();
+
+        size_t budget = static_cast<size_t>(-1);
+        flush(index, budget);
+        mDraining.fetch_sub(1, std::memory_order_relaxed);
+        mPlaying .fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // Every voice is playing; pick one to take over. Playing voices
+        // are kept in trigger order, so the oldest one is at the front.
+        index = mOldest;
+        if (mSteal == Steal::QUIETEST) {
+            for (size_t i = 0; i < mVoices.size(); i++)
+                if (mVoices[i].level < mVoices[index].level)
+                    index = i;
+        }
+        unlink(index);
+        mSteals.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const Asample &sample = *mBank[event.index];
+    Voice &v = mVoices[index];
+
+    v.data      = static_cast<const char*>(sample.getRawData());
+
+    if (v.compressed)
+        v.reader.reset(sample.getCompressed().get());
+    v.size      = sample.getFrameCount();
+    v.read      = 0;
+    v.gainL     = event.gainL * sample.getPeak();
+    v.gainR     = event.gainR * sample.getPeak();
+    v.level     = std::max(std::fabs(v.gainL), std::fabs(v.gainR));
+    v.active    = true;
+
+    link(index);
+
+    if (v.soxr != nullptr) {
+        // Play out whatever is inside the resampler, then the new note.
+        double const ratio = static_cast<double>(mOutputSampleRate) / mInputSampleRate;
+        v.remaining = static_cast<size_t>(std::ceil(v.size * ratio + soxr_delay(v.soxr)));
+    } else {
+        v.remaining = v.size;
+    }
+}
+
+void Instrument::finish(size_t index)
+{
+    mVoices[index].active = false;
+    unlink(index);
+    mFree.push_back(index);
+    mPlaying.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Instrument::link(size_t index)
+{
+    Voice &v = mVoices[index];
+    v.older = mNewest;
+    v.newer = NoVoice;
+
+    if (mNewest != NoVoice)
+        mVoices[mNewest].newer = index;
+    else
+        mOldest = index;
+
+    mNewest = index;
+}
+
+void Instrument::unlink(size_t index)
+{
+    Voice &v = mVoices[index];
+
+    if (v.older != NoVoice)
+        mVoices[v.older].newer = v.newer;
+    else
+        mOldest = v.newer;
+
+    if (v.newer != NoVoice)
+        mVoices[v.newer].older = v.older;
+    else
+        mNewest = v.older;
+
+    v.older = NoVoice;
+    v.newer = NoVoice;
+}
+
+void Instrument::silence(size_t index)
+{
+    Voice &v = mVoices[index];
+
+    v.active = false;
+    unlink(index);
+    mPlaying.fetch_sub(1, std::memory_order_relaxed);
+
+    if (v.soxr == nullptr || mScratch.empty()) {
+        mFree.push_back(index);
+        return;
+    }
+
+    // Feed silence from now on, and pull out every frame still owed for
+    // the input already taken in. The second pass clears the frames the
+    // filter looks back on from the first one.
+    v.read    = v.size;
+    v.drain   = static_cast<size_t>(std::ceil(soxr_delay(v.soxr)));
+    v.flushes = 2;
+
+    mFlushing.push_back(index);
+    mDraining.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Instrument::flush(size_t index, size_t &budget)
+{
+    Voice &v = mVoices[index];
+
+    size_t const chunk = mScratch.size() / mChannels;
+
+    while (v.flushes != 0 && budget != 0)
+    {
+        size_t const want = std::min(std::min(v.drain, chunk), budget);
+        size_t const done = (want != 0) ? soxr_output(v.soxr, mScratch.data(), want) : 0;
+
+        v.drain -= done;
+        budget  -= done;
+
+        // A pass ends once its frames are out, or if nothing more comes.
+        if (v.drain == 0 || done == 0) {
+            v.flushes -= 1;
+            v.drain    = (v.flushes != 0) ? static_cast<size_t>(std::ceil(soxr_delay(v.soxr))) : 0;
+        }
+    }
+
+    return v.flushes == 0;
+}
+
+void Instrument::render_voice(size_t index, AfBuffer &buffer, const ArenderConfig &config)
+{
+    Voice &v = mVoices[index];
+    Afloat* const dst = buffer.data() + config.frameOffset * config.channels;
+
+    assert(config.channels <= MAX_CHANNELS);
+
+    Afloat gain[MAX_CHANNELS];
+    Kernel::spread_gain(gain, config.channels, v.gainL, v.gainR);
+
+    size_t const frames = std::min<size_t>(config.frameCount, v.remaining);
+    Afloat peak = 0.0f;
+
+    if (v.soxr == nullptr)
+    {
+        if (mFormat == Asample::Format::FLOAT32) {
+            const Afloat* const src = reinterpret_cast<const Afloat*>(v.data + v.read * v.step);
+
+            if (config.quality != ArenderConfig::Quality::MUTE)
+                Kernel::mix_f32(dst, config.channels, src, mChannels, frames, gain);
+
+            for (size_t i = 0; i < frames * mChannels; i += LevelStride * mChannels)
+                peak = std::max(peak, std::fabs(src[i]));
+        } else if (v.compressed) {
+            Afloat* out  = dst;
+            size_t  read = v.read;
+            size_t  left = frames;
+
+            // Mix one decoded block at a time.
+            while (left != 0) {
+                size_t            n   = left;
+                const Aint* const src = v.reader.fetch(read, n);
+
+                if (config.quality != ArenderConfig::Quality::MUTE)
+                    Kernel::mix_i16(out, config.channels, src, mChannels, n, gain);
+
+                for (size_t i = 0; i < n * mChannels; i += LevelStride * mChannels)
+                    peak = std::max(peak, std::fabs(to_Afloat(src[i])));
+
+                out  += n * config.channels;
+                read += n;
+                left -= n;
+            }
+        } else {
+            const Aint* const src = reinterpret_cast<const Aint*>(v.data + v.read * v.step);
+
+            if (config.quality != ArenderConfig::Quality::MUTE)
+                Kernel::mix_i16(dst, config.channels, src, mChannels, frames, gain);
+
+            for (size_t i = 0; i < frames * mChannels; i += LevelStride * mChannels)
+                peak = std::max(peak, std::fabs(to_Afloat(src[i])));
+        }
+
+        v.read += frames;
+    }
+    else
+    {
+        size_t const done = soxr_output(v.soxr, mScratch.data(), frames);
+
+        soxr_error_t const error = soxr_error(v.soxr);
+        if (error) { throw std::runtime_error(error); }
+
+        if (config.quality != ArenderConfig::Quality::MUTE)
+            Kernel::mix_f32(dst, config.channels, mScratch.data(), mChannels, done, gain);
+
+        for (size_t i = 0; i < done * mChannels; i += LevelStride * mChannels)
+            peak = std::max(peak, std::fabs(mScratch[i]));
+    }
+
+    v.level      = peak * std::max(std::fabs(v.gainL), std::fabs(v.gainR));
+    v.remaining -= frames;
+
+    if (v.remaining == 0)
+        finish(index);
+}
+
+void Instrument::render(AfBuffer& buffer, const ArenderConfig& config)
+{
+    AallocGuard guard;
+
+    if (config.quality == ArenderConfig::Quality::SKIP)
+        return;
+
+    // Preallocated by configure(); see AallocGuard.
+    if (mScratch.size() < config.frameCount * mChannels)
+        mScratch.resize(config.frameCount * mChannels);
+
+    // Start the notes triggered since the last block.
+    Event event;
+    while (mEvents.read(&event, 1) == 1)
+    {
+        if (event.index != SilenceEvent) {
+            start(event);
+            continue;
+        }
+
+        // Unlike a stolen voice, a silenced one must not play anything
+        // of its note once it is reused.
+        while (mOldest != NoVoice)
+            silence(mOldest);
+    }
+
+    // Spread the flushes of silenced voices over the following blocks,
+    // one block of frames per voice each time, so that flushing never
+    // costs more than playing them did.
+    for (size_t i = 0; i < mFlushing.size(); )
+    {
+        size_t budget = config.frameCount;
+        if (flush(mFlushing[i], budget) == false) {
+            i++;
+            continue;
+        }
+
+        mFree.push_back(mFlushing[i]);
+        mFlushing[i] = mFlushing.back();
+        mFlushing.pop_back();
+        mDraining.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    for (size_t i = 0; i < mVoices.size(); i++)
+        if (mVoices[i].active)
+            render_voice(i, buffer, config);
+}
+
+}
+}
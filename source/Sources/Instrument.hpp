@@ -0,0 +1,209 @@
+//  Instrument.hpp :: Polyphonic sampler instrument
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef SOURCE_INSTRUMENT_H
+#define SOURCE_INSTRUMENT_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "../Frame.hpp"
+#include "../RingBuffer.hpp"
+#include "../Sample.hpp"
+#include "../Source.hpp"
+
+struct soxr;
+
+namespace awe {
+namespace Source {
+
+/*! Polyphonic instrument playing notes out of a fixed sample bank.
+ *
+ *  Triggering a note through a \ref Sampler allocates the sampler and
+ *  its resampler and inserts it into a track. An instrument instead is
+ *  attached to a track once and owns a fixed pool of voices, each with
+ *  a resampler that is created up front and kept running across notes.
+ *  \ref trigger() only pushes an event onto a wait-free queue; the
+ *  event is picked up by the next \ref render() call, which hands it to
+ *  a free voice in constant time. Neither side allocates or locks.
+ *
+ *  When all voices are busy, a playing voice is stolen according to
+ *  the \ref Steal policy. A stolen voice lets the few milliseconds of
+ *  audio already inside its resampler play out before the new note.
+ *
+ *  An instrument with no voice playing or being flushed and no event
+ *  queued reports itself inactive, so that its track skips it and
+ *  \ref awe::AOfflineEngine::render() can run out of active sources.
+ *  Tracks keep polling inactive sources, and the next \ref trigger()
+ *  makes it active again.
+ *
+ *  All samples in the bank must have the same sampling rate, channel
+ *  count and storage format, and the bank cannot change after
+ *  construction.
+ */
+class Instrument : public awe::Asource
+{
+public:
+    using SamplePtr = std::shared_ptr<Asample>;
+
+    //! Voice stealing policy.
+    enum class Steal : uint8_t
+    {
+        OLDEST   = 0x0, //!< Steal the voice that was triggered first, in constant time.
+        QUIETEST = 0x1  //!< Steal the voice with the lowest output level; this scans every voice.
+    };
+
+private:
+    //! Note-on request from the control thread.
+    struct Event
+    {
+        uint32_t    index;  //!< Bank index, or `SilenceEvent`
+        Afloat      gainL;  //!< Left channel gain
+        Afloat      gainR;  //!< Right channel gain
+    };
+
+    static constexpr uint32_t SilenceEvent = 0xFFFFFFFF;
+
+    //! End of the list of playing voices.
+    static constexpr size_t NoVoice = static_cast<size_t>(-1);
+
+    //! Single playing note.
+    struct Voice
+    {
+        ::soxr    * soxr;       //!< Resampler, or null if at output rate
+        const char* data;       //!< Sample data being played
+        const void* silence;    //!< Input fed to the resampler after the sample
+        size_t      step;       //!< Size of an input frame in bytes, once decoded
+        size_t      size;       //!< Number of frames in sample
+        size_t      read;       //!< Number of frames fed from sample
+        size_t      remaining;  //!< Number of frames left to output
+        size_t      older;      //!< Playing voice triggered before this one, or `NoVoice`
+        size_t      newer;      //!< Playing voice triggered after this one, or `NoVoice`
+        size_t      drain;      //!< Number of frames left to pull out in this flush pass
+        uint8_t     flushes;    //!< Number of flush passes left before the voice is free
+        Afloat      gainL;      //!< Left channel gain, including sample peak
+        Afloat      gainR;      //!< Right channel gain, including sample peak
+        Afloat      level;      //!< Output level of the last block
+        bool        active;     //!< Voice is playing
+        bool        compressed; //!< Sample data is decoded through the reader
+
+        AadpcmReader reader;    //!< Decoder of compressed samples
+
+        //! Feeds the resampler.
+        static size_t input_fn(void* data, const void** buffer, size_t frames);
+    };
+
+    std::vector<SamplePtr>  mBank;              //!< Sample bank
+    unsigned long           mOutputSampleRate;  //!< Output sampling rate
+    unsigned long           mInputSampleRate;   //!< Sampling rate of the bank
+    Achan                   mChannels;          //!< Channel count of the bank
+    Asample::Format         mFormat;            //!< Storage format of the bank
+    Steal                   mSteal;             //!< Voice stealing policy
+
+    std::vector<Voice>      mVoices;            //!< Voice pool
+    std::vector<size_t>     mFree;              //!< Stack of free voice indices
+    std::vector<size_t>     mFlushing;          //!< Silenced voices not free yet
+    size_t                  mOldest;            //!< First playing voice in trigger order
+    size_t                  mNewest;            //!< Last playing voice in trigger order
+    ARingBuffer<Event>      mEvents;            //!< Pending triggers
+    AfBuffer                mSilence;           //!< Zeroes fed to idle resamplers, in either format
+    AfBuffer                mScratch;           //!< Resampler output buffer
+
+    std::atomic<bool>       mActive;            //!< Instrument is attached and playing
+    std::atomic<size_t>     mPlaying;           //!< Number of active voices
+    std::atomic<size_t>     mDraining;          //!< Number of silenced voices not flushed yet
+    std::atomic<size_t>     mSteals;            //!< Number of stolen voices
+    std::atomic<size_t>     mDropped;           //!< Number of triggers lost to a full queue
+
+    //! Starts a note on a free or stolen voice.
+    void start(const Event &event);
+
+    //! Returns a voice to the free stack.
+    void finish(size_t index);
+
+    //! Appends a voice to the list of playing voices.
+    void link(size_t index);
+
+    //! Removes a voice from the list of playing voices.
+    void unlink(size_t index);
+
+    //! Stops a voice and queues its resampler to be flushed.
+    void silence(size_t index);
+
+    /*! Empties the resampler of a silenced voice of the note it was
+     *  playing, over as many calls as it takes.
+     *  \param index  voice to flush.
+     *  \param budget number of frames that may be pulled out; this is
+     *                decreased by the number of frames pulled out.
+     *  \return true if the voice is flushed.
+     */
+    bool flush(size_t index, size_t &budget);
+
+    //! Renders one voice onto the target buffer.
+    void render_voice(size_t index, AfBuffer &buffer, const ArenderConfig &config);
+
+public:
+    /*! Instrument constructor.
+     *  \param bank               samples that can be triggered.
+     *  \param output_sample_rate output sampling rate.
+     *  \param voices             number of notes that can play at once.
+     *  \param steal              voice stealing policy.
+     *  \param frames             number of frames to preallocate the
+     *                            resampler output buffer for. This is
+     *                            also done by \ref configure() when the
+     *                            instrument is attached to a track.
+     */
+    Instrument(
+        const std::vector<SamplePtr> &bank,
+        unsigned long output_sample_rate,
+        size_t voices = 32,
+        Steal steal = Steal::OLDEST,
+        size_t frames = 0
+    );
+
+    Instrument(const Instrument&) = delete;
+    Instrument& operator=(const Instrument&) = delete;
+
+    virtual ~Instrument();
+
+    //! Stops the instrument; it stays inactive until \ref make_active().
+    virtual void drop();
+    virtual void configure(const ArenderConfig& config);
+    virtual void make_active(void*);
+    //! \return false if dropped, or if no voice is playing or being flushed and no event is queued.
+    virtual bool is_active() const;
+    virtual void render(AfBuffer& buffer, const ArenderConfig& config);
+
+    /*! Plays a note.
+     *
+     *  This function is wait-free and does not allocate. It must only be
+     *  called from one thread at a time.
+     *
+     *  \param index index of the sample in the bank.
+     *  \param gain  channel volumes.
+     *  \return false if the index is invalid or the trigger queue is full.
+     */
+    bool trigger(size_t index, Asfloatf gain = Asfloatf({ 1.0f, 1.0f }));
+
+    /*! Stops all playing notes at the start of the next block.
+     *  Unlike stolen voices, silenced voices start their next note
+     *  without any of the audio left inside their resamplers. Their
+     *  resamplers are emptied over the following blocks at the pace
+     *  they were playing, or right away for a voice needed by a new
+     *  note.
+     *  This has the same threading rules as \ref trigger().
+     */
+    bool silence();
+
+    inline size_t getVoiceCount     () const { return mVoices.size(); }
+    inline size_t getPlayingVoices  () const { return mPlaying.load(std::memory_order_relaxed); }
+    inline size_t getSteals         () const { return mSteals .load(std::memory_order_relaxed); }
+    inline size_t getDroppedTriggers() const { return mDropped.load(std::memory_order_relaxed); }
+    inline const std::vector<SamplePtr>& getBank() const { return mBank; }
+};
+
+}
+}
+
+#endif
@@ -3,7 +3,11 @@
 
 #include "Sampler.hpp"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include "../AllocGuard.hpp"
+#include "../Kernels.hpp"
 #include "../soxr-0.1.1/src/soxr.h"
 
 namespace awe {
@@ -16,78 +20,261 @@ struct SoXR
     soxr_t          soxr;       //!< SoXR object.
     soxr_error_t    soxr_error; //!< SoXR error string.
 
-    std::shared_ptr<AiBuffer>
-                iptr; //!< Input pointer
+    std::shared_ptr<const void>
+                keep; //!< Keeps the input buffer alive
+    const char* iptr; //!< Input pointer
     size_t      chan; //!< Number of channels in sound sample.
     size_t      size; //!< Number frames in sound sample to play.
-    size_t      read; //!< Number of frames read from input buffer.
+    size_t      step; //!< Size of an input frame in bytes, once decoded.
 
-    SoXR(const Sampler::SamplePtr& sample, unsigned long output_sample_rate)
+    /*! Loop points and playback position.
+     *  Going forward, `loop.now` is the next frame to read. Going backward
+     *  through a ping-pong loop, it is the frame after the next one.
+     *  This is moved by \ref segment() and \ref advance() rather than by
+     *  `AuLoop::operator+=`; see \ref Sampler.
+     */
+    AuLoop      loop;
+
+    std::vector<char>
+                reverse; //!< Input frames of a ping-pong loop, played backward.
+                         //!< Allocated up front, as loops are set while playing.
+
+    bool         compressed; //!< Input is decoded through the reader.
+    AadpcmReader reader;     //!< Decoder of compressed samples.
+
+    double      ratio; //!< Input to output sampling rate ratio at normal speed.
+    double      speed; //!< Playing speed the resampler is set to.
+
+    //! Number of frames reversed at a time in a ping-pong loop.
+    static constexpr size_t REVERSE_FRAMES = 1024;
+
+    SoXR(
+        const Sampler::SamplePtr& sample, unsigned long output_sample_rate,
+        const AuLoop& loop_, double max_speed, double speed_
+    )
         : soxr(0)
         , soxr_error(nullptr)
-        , iptr(sample->getSource())
+        , keep(sample->getStorage())
+        , iptr(static_cast<const char*>(sample->getRawData()))
         , chan(sample->getChannelCount())
         , size(sample->getFrameCount())
-        , read(0)
+        , step(sample->getChannelCount() * (sample->getFormat() == Asample::Format::FLOAT32 ? sizeof(Afloat) : sizeof(Aint)))
+        , loop(0, 0, 0, Loop::Mode::ONCE)
+        , reverse(REVERSE_FRAMES * step)
+        , compressed(sample->getFormat() == Asample::Format::ADPCM)
+        , reader()
+        , ratio(static_cast<double>(sample->getSampleRate()) / static_cast<double>(output_sample_rate))
+        , speed(speed_)
     {
+        set_loop(loop_);
+
+        // Compressed samples are decoded into 16-bit blocks.
+        if (compressed)
+            reader.reset(sample->getCompressed().get());
+
         /* TODO Follow up bug report in soxr@sf.
          * This is a workaround for a bug in soxr-0.1.1 where I:O sampling
          * ratios very close(~10^-6) to 1:1 will crash the library.
+         * The variable-rate resampler does not have this problem.
          */
-        if (sample->getSampleRate() == output_sample_rate) {
+        bool const variable = max_speed > 0.0;
+
+        if (variable == false && sample->getSampleRate() == output_sample_rate) {
             fprintf(stderr, "libawe [debug] workaround bad I/O ratio crash on libSoXR.\n");
             return;
         }
 
-        soxr_io_spec_t      const soxIOs = soxr_io_spec(SOXR_INT16_I, SOXR_FLOAT32_I);
-        soxr_quality_spec_t const soxQs  = soxr_quality_spec(SOXR_MQ, 0);
+        // Floating point samples are fed to the resampler as they are.
+        soxr_datatype_t     const soxIn  = sample->getFormat() == Asample::Format::FLOAT32 ? SOXR_FLOAT32_I : SOXR_INT16_I;
+        soxr_io_spec_t      const soxIOs = soxr_io_spec(soxIn, SOXR_FLOAT32_I);
+        soxr_quality_spec_t const soxQs  = variable ? soxr_quality_spec(SOXR_HQ, SOXR_VR) : soxr_quality_spec(SOXR_MQ, 0);
         soxr_runtime_spec_t const soxRTs = soxr_runtime_spec(SoXR_threads);
 
+        // The variable-rate resampler is sized for the highest I/O ratio
+        // it will be set to, which is given as the ratio of the rates.
         soxr = soxr_create(
-                static_cast<double>  (sample->getSampleRate()),     // Input rate
+                static_cast<double>  (sample->getSampleRate()) * (variable ? max_speed : 1.0), // Input rate
                 static_cast<double>  (output_sample_rate),          // Output rate
                 static_cast<unsigned>(sample->getChannelCount()),   // Channel Count
                 &soxr_error, &soxIOs, &soxQs, &soxRTs
                 );
-        if (soxr_error) { throw new std::runtime_error(soxr_error); }
+        if (soxr_error) { throw std::runtime_error(soxr_error); }
+
+        if (variable) {
+            soxr_error = soxr_set_io_ratio(soxr, ratio * speed, 0);
+            if (soxr_error) { throw std::runtime_error(soxr_error); }
+        }
 
         soxr_error = soxr_set_input_fn(
                 soxr, (soxr_input_fn_t) soxr_input_fn,
                 this, IO_BUFFER_SIZE
                 );
-        if (soxr_error) { throw new std::runtime_error(soxr_error); }
+        if (soxr_error) { throw std::runtime_error(soxr_error); }
     }
 
     ~SoXR() {
         if (soxr != 0)
             soxr_delete(soxr);
     }
+
+    //! \return true if the position goes back to the loop at its end.
+    inline bool looping() const
+    {
+        return Loop::getMethod(loop.mode) == Loop::Mode::REPEAT
+            || Loop::getMethod(loop.mode) == Loop::Mode::ALTERNATING;
+    }
+
+    /*! Counts the frames up to the next loop point or the end of the
+     *  sample, so that the position is checked once per run of frames
+     *  rather than once per frame.
+     *  \return number of frames to the next turn, at most `len`.
+     */
+    size_t segment(size_t len) const
+    {
+        if (Loop::isReverse(loop.mode))
+            return std::min(len, loop.now - loop.begin);
+
+        size_t const limit = (looping() && loop.now < loop.end) ? loop.end : size;
+        return (loop.now < limit) ? std::min(len, limit - loop.now) : 0;
+    }
+
+    //! \return true once the whole sample has been read.
+    inline bool finished() const { return segment(1) == 0; }
+
+    /*! Moves the position by a run of frames given by \ref segment(),
+     *  turning around at the loop points.
+     */
+    void advance(size_t len)
+    {
+        if (Loop::isReverse(loop.mode)) {
+            loop.now -= len;
+
+            // Bounce off the start of a ping-pong loop.
+            if (loop.now == loop.begin) {
+                loop.mode = +loop.mode;
+                loop.now  = loop.begin + 1;
+            }
+        } else {
+            loop.now += len;
+
+            if (looping() && loop.now == loop.end) {
+                if (Loop::getMethod(loop.mode) == Loop::Mode::ALTERNATING) {
+                    loop.mode = -loop.mode;
+                    loop.now  = loop.end - 1;
+                } else {
+                    loop.now  = loop.begin;
+                }
+            }
+        }
+    }
+
+    //! Moves the position by `len` frames without reading them.
+    void skip(size_t len)
+    {
+        while (len != 0) {
+            size_t const run = segment(len);
+            if (run == 0)
+                break;
+
+            advance(run);
+            len -= run;
+        }
+    }
+
+    //! Turns playback forward from the frame after the last one read.
+    void forward()
+    {
+        if (Loop::isReverse(loop.mode)) {
+            loop.mode = +loop.mode;
+            loop.now += 1;
+        }
+    }
+
+    //! Replaces the loop points and mode, keeping the position.
+    void set_loop(const AuLoop& l)
+    {
+        forward();
+
+        loop.begin = l.begin;
+        loop.end   = l.end;
+        loop.mode  = +l.mode;
+    }
+
+    //! \return next frame of the sample to be read.
+    inline size_t position() const
+    {
+        return Loop::isReverse(loop.mode) ? loop.now - 1 : loop.now;
+    }
+
+    /*! Retrieves input frames without consuming them.
+     *  \param[in,out] len maximum number of frames to retrieve, clamped to
+     *                     the next loop point, to the end of the sample
+     *                     and, for compressed samples, to the end of the
+     *                     decoded block.
+     *  \return pointer to `len` interleaved frames in playing order.
+     */
+    const char* input(size_t &len)
+    {
+        len = segment(len);
+
+        if (len == 0)
+            return iptr;
+
+        if (Loop::isReverse(loop.mode) == false) {
+            if (compressed)
+                return reinterpret_cast<const char*>(reader.fetch(loop.now, len));
+
+            return iptr + loop.now * step;
+        }
+
+        // Backward: read frames [first, now) and reverse them.
+        size_t first = loop.now - std::min(len, REVERSE_FRAMES);
+        const char* src;
+
+        if (compressed) {
+            size_t const block = reader.getBuffer()->getBlockFrames();
+            first = std::max(first, (loop.now - 1) / block * block);
+
+            size_t count = loop.now - first;
+            src = reinterpret_cast<const char*>(reader.fetch(first, count));
+        } else {
+            src = iptr + first * step;
+        }
+
+        len = loop.now - first;
+
+        for (size_t i = 0; i < len; i++)
+            std::memcpy(reverse.data() + i * step, src + (len - 1 - i) * step, step);
+
+        return reverse.data();
+    }
 };
 
+constexpr size_t SoXR::REVERSE_FRAMES;
+
 size_t soxr_input_fn(SoXR* ptr, soxr_cbuf_t* buf, size_t len)
 {
-    *buf = (ptr->iptr->data() + (ptr->read * ptr->chan));
-
-    /****/ if (ptr->read >= ptr->size) {
-        len = 0;
-    } else if (ptr->read + len >= ptr->size) {
-        len = ptr->size - ptr->read;
-    } else if (ptr->read + len <  ptr->size) {
-        /* do nothing */
-    }
+    *buf = ptr->input(len);
 
-    ptr->read += len;
+    ptr->advance(len);
     return len;
 }
 
 
-Sampler::Sampler(const Sampler::SamplePtr &sample, unsigned long output_sample_rate, Asfloatf gain)
+Sampler::Sampler(const Sampler::SamplePtr &sample, unsigned long output_sample_rate, Asfloatf gain, size_t frames, double max_speed)
     : mSample           (sample)
     , mOutputSampleRate (output_sample_rate)
-    , mChannelGain      (gain)
-    , soxr              (std::make_shared<SoXR>(mSample, mOutputSampleRate))
+    , mChannelGain      ()
+    , mControls         (16)
+    , mPosition         (0)
+    , mLoop             (0, mSample->getFrameCount(), Loop::Mode::ONCE)
+    , mMaxSpeed         (std::max(max_speed, 0.0))
+    , mSpeed            (1.0)
+    , soxr              (std::make_shared<SoXR>(mSample, mOutputSampleRate, mLoop, mMaxSpeed, mSpeed.load()))
+    , mScratch          (frames * mSample->getChannelCount(), 0.f)
 {
     assert(mSample && "Invalid pointer to sample.");
+    Kernel::spread_gain(mChannelGain.data.data(), MAX_CHANNELS, gain[0], gain[1]);
 }
 
 Sampler::~Sampler () {
@@ -98,52 +285,171 @@ void Sampler::drop() {
     soxr.reset();
 }
 
+bool Sampler::set_gain(Afloat left, Afloat right) {
+    Kernel::spread_gain(mChannelGain.data.data(), MAX_CHANNELS, left, right);
+    return true;
+}
+
+bool Sampler::set_channel_gain(Achan channel, Afloat gain) {
+    if (channel >= MAX_CHANNELS)
+        return false;
+
+    mChannelGain[channel] = gain;
+    return true;
+}
+
+bool Sampler::set_loop(size_t begin, size_t end, Loop::Mode mode) {
+    if (begin >= end || end > mSample->getFrameCount())
+        return false;
+
+    // A ping-pong loop needs two frames to turn around.
+    if (Loop::getMethod(mode) == Loop::Mode::ALTERNATING && end - begin < 2)
+        return false;
+
+    Control const control = { Control::Type::LOOP, +mode, begin, end };
+    return mControls.write(&control, 1) == 1;
+}
+
+bool Sampler::release() {
+    Control const control = { Control::Type::RELEASE, Loop::Mode::ONCE, 0, 0 };
+    return mControls.write(&control, 1) == 1;
+}
+
+bool Sampler::seek(size_t frame) {
+    if (frame > mSample->getFrameCount())
+        return false;
+
+    Control const control = { Control::Type::SEEK, Loop::Mode::ONCE, frame, 0 };
+    return mControls.write(&control, 1) == 1;
+}
+
+void Sampler::apply_controls() {
+    Control control;
+    while (mControls.read(&control, 1) == 1)
+    {
+        switch (control.type)
+        {
+        case Control::Type::LOOP:
+            mLoop = AuLoop(control.begin, control.end, control.mode);
+            if (soxr)
+                soxr->set_loop(mLoop);
+            break;
+
+        case Control::Type::RELEASE:
+            mLoop.mode = Loop::Mode::ONCE;
+            if (soxr)
+                soxr->set_loop(mLoop);
+            break;
+
+        case Control::Type::SEEK:
+            if (soxr) {
+                soxr->forward();
+                soxr->loop.now = control.begin;
+            }
+            break;
+        }
+    }
+}
+
+bool Sampler::set_speed(double speed) {
+    if (speed <= 0.0 || speed > mMaxSpeed)
+        return false;
+
+    // Picked up by the next render()
+    mSpeed.store(speed, std::memory_order_relaxed);
+    return true;
+}
+
+void Sampler::configure(const ArenderConfig& config) {
+    if (mScratch.size() < config.frameCount * mSample->getChannelCount())
+        mScratch.resize(config.frameCount * mSample->getChannelCount());
+}
+
 void Sampler::make_active(void*) {
-    soxr = std::make_shared<SoXR>(mSample, mOutputSampleRate);
+    soxr = std::make_shared<SoXR>(mSample, mOutputSampleRate, mLoop, mMaxSpeed, mSpeed.load(std::memory_order_relaxed));
+    mPosition.store(0, std::memory_order_relaxed);
 }
 
 bool Sampler::  is_active() const {
     if (soxr)
-        return soxr->read < soxr->size;
+        return soxr->finished() == false;
     else
         return false;
 }
 
 void Sampler::render(AfBuffer& buffer, const ArenderConfig& config)
 {
+    AallocGuard guard;
+
+    // Loop, seek and release requests made since the last block.
+    apply_controls();
+
+    render_block(buffer, config);
+
+    mPosition.store(soxr->position(), std::memory_order_relaxed);
+}
+
+void Sampler::render_block(AfBuffer& buffer, const ArenderConfig& config)
+{
+    assert(config.channels <= MAX_CHANNELS);
+
+    // Hoist the per-channel gain out of the mixing loops.
+    Afloat gain[MAX_CHANNELS];
+    for(Achan c = 0; c < config.channels; c++)
+        gain[c] = mChannelGain[c] * mSample->getPeak();
+
     // !workaround See TODO in SoXR::SoXR
     if (soxr->soxr == 0)
     {
         switch (config.quality)
         {
         case ArenderConfig::Quality::MUTE:
-            soxr->read += config.frameCount;
+            soxr->skip(config.frameCount);
 
         case ArenderConfig::Quality::SKIP:
             return;
 
         default:
-            /****/ if (mSample->getChannelCount() == 2) {
-                for (size_t f = 0; f < config.frameCount; f++) {
-                    size_t i = soxr->read + f;
-                    size_t j = config.frameOffset + f;
-                    buffer.data() [j*2  ] += to_Afloat(soxr->iptr->at(i*2  )) * mChannelGain[0] * mSample->getPeak();
-                    buffer.data() [j*2+1] += to_Afloat(soxr->iptr->at(i*2+1)) * mChannelGain[1] * mSample->getPeak();
-                }
-            } else if (mSample->getChannelCount() == 1) {
-                for (size_t f = 0; f < config.frameCount; f++) {
-                    size_t i = soxr->read + f;
-                    size_t j = config.frameOffset + f;
-                    buffer.data() [j*2  ] += to_Afloat(soxr->iptr->at(i  )) * mChannelGain[0] * mSample->getPeak();
-                    buffer.data() [j*2+1] += to_Afloat(soxr->iptr->at(i  )) * mChannelGain[1] * mSample->getPeak();
-                }
-            }
+            Afloat* dst  = buffer.data() + config.frameOffset * config.channels;
+            size_t  left = config.frameCount;
+
+            // Do not read past the end of the sample on the last block nor
+            // past a loop point; compressed samples come one decoded block
+            // at a time.
+            while (left != 0)
+            {
+                size_t            frames = left;
+                char const* const src    = soxr->input(frames);
+
+                if (frames == 0)
+                    break;
+
+                if (mSample->getFormat() == Asample::Format::FLOAT32)
+                    Kernel::mix_f32(dst, config.channels, reinterpret_cast<const Afloat*>(src), mSample->getChannelCount(), frames, gain);
+                else
+                    Kernel::mix_i16(dst, config.channels, reinterpret_cast<const Aint  *>(src), mSample->getChannelCount(), frames, gain);
 
-            soxr->read += config.frameCount;
+                soxr->advance(frames);
+                dst        += frames * config.channels;
+                left       -= frames;
+            }
             return;
         }
     } else {
-        AfBuffer oBuffer(buffer.size(), 0.f);
+        // Preallocated by configure(); see AallocGuard.
+        AfBuffer& oBuffer = mScratch;
+        if (oBuffer.size() < config.frameCount * soxr->chan)
+            oBuffer.resize(config.frameCount * soxr->chan);
+
+        // Glide to a new speed over this block.
+        double const speed = mSpeed.load(std::memory_order_relaxed);
+
+        if (soxr->speed != speed) {
+            soxr->soxr_error = soxr_set_io_ratio(soxr->soxr, soxr->ratio * speed, config.frameCount);
+            if (soxr->soxr_error) { throw std::runtime_error(soxr->soxr_error); }
+
+            soxr->speed = speed;
+        }
 
         switch (config.quality)
         {
@@ -160,19 +466,9 @@ void Sampler::render(AfBuffer& buffer, const ArenderConfig& config)
             soxr->soxr_error = soxr_error(soxr->soxr);
             if (soxr->soxr_error) { throw std::runtime_error(soxr->soxr_error); }
 
-            /****/ if (mSample->getChannelCount() == 2) {
-                for (size_t i = 0; i < oDone; i++) {
-                    size_t j = config.frameOffset + i;
-                    buffer.data() [j*2  ] += oBuffer[i*2  ] * mChannelGain[0] * mSample->getPeak();
-                    buffer.data() [j*2+1] += oBuffer[i*2+1] * mChannelGain[1] * mSample->getPeak();
-                }
-            } else if (mSample->getChannelCount() == 1) {
-                for (size_t i = 0; i < oDone; i++) {
-                    size_t j = config.frameOffset + i;
-                    buffer.data() [j*2  ] += oBuffer[i  ] * mChannelGain[0] * mSample->getPeak();
-                    buffer.data() [j*2+1] += oBuffer[i  ] * mChannelGain[1] * mSample->getPeak();
-                }
-            }
+            Afloat* const dst = buffer.data() + config.frameOffset * config.channels;
+
+            Kernel::mix_f32(dst, config.channels, oBuffer.data(), mSample->getChannelCount(), oDone, gain);
 
             return;
         }
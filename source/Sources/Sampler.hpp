@@ -1,12 +1,15 @@
-//  Sampler.hpp :: Single mono/stereo source sampler
+//  Sampler.hpp :: Single source sampler
 //  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
 
 #ifndef SOURCE_SAMPLER_H
 #define SOURCE_SAMPLER_H
 
+#include <atomic>
 #include <memory>
 
 #include "../Frame.hpp"
+#include "../Loop.hpp"
+#include "../RingBuffer.hpp"
 #include "../Sample.hpp"
 #include "../Source.hpp"
 
@@ -23,6 +26,32 @@ namespace Source {
 static unsigned char SoXR_threads = 1;
 struct SoXR;
 
+/*! Sound sample renderer.
+ *
+ *  Plays a sample of any channel count into a buffer of any channel
+ *  count; see \ref Kernel::mix_i16() for how the channels are mapped.
+ *  Every output channel has its own volume.
+ *
+ *  A sampler plays its sample from the start to the end, or around a
+ *  loop set with \ref set_loop(). Loop points are spliced into the input
+ *  of the resampler, so they are exact to the sample frame whatever the
+ *  output sampling rate is.
+ *
+ *  The loop is kept in an \ref AuLoop and uses its \ref Loop::Mode, but
+ *  is not stepped through \ref Loop::Loop::operator+=(). That operator
+ *  moves one step at a time and drops whatever overshoots a loop point,
+ *  while the sampler moves by whole runs of frames up to the next loop
+ *  point and must land on it exactly. `paused` is not used.
+ *
+ *  \ref set_loop(), \ref release() and \ref seek() only push a request
+ *  onto a wait-free queue, which is picked up at the start of the next
+ *  \ref render() call, so they can be called while the sampler plays.
+ *
+ *  A sampler built with a maximum speed uses the variable-rate resampler
+ *  of SoXR, so that its playing speed (and with it, its pitch) can be
+ *  changed at any time with \ref set_speed() without rebuilding the
+ *  resampler. Speed changes are ramped over one rendered block.
+ */
 class Sampler : public awe::Asource
 {
 public:
@@ -30,15 +59,127 @@ public:
 
     SamplePtr       mSample;                //!< Sample to render.
     unsigned long   mOutputSampleRate;      //!< Output sampling rate.
-    Asfloatf        mChannelGain;           //!< Channel volumes.
+    Aframe<Afloat, MAX_CHANNELS>
+                    mChannelGain;           //!< Volume of each output channel.
 
 private:
+    //! Playback control request from the control thread.
+    struct Control
+    {
+        enum class Type : uint8_t { LOOP, RELEASE, SEEK };
+
+        Type        type;   //!< Request type
+        Loop::Mode  mode;   //!< Loop mode, for `LOOP`
+        size_t      begin;  //!< First loop frame for `LOOP`, target frame for `SEEK`
+        size_t      end;    //!< Frame after the last loop frame, for `LOOP`
+    };
+
+    ARingBuffer<Control>
+                    mControls;              //!< Pending control requests.
+    std::atomic<size_t>
+                    mPosition;              //!< Next frame to play, as of the last block.
+
+    AuLoop          mLoop;                  //!< Loop points and traversal mode, in sample frames.
+    double          mMaxSpeed;              //!< Highest playing speed, or 0 for fixed speed.
+    std::atomic<double>
+                    mSpeed;                 //!< Playing speed, set by the control thread.
+
     std::shared_ptr<SoXR> soxr;
 
+    AfBuffer        mScratch;               //!< Resampler output buffer, reused across blocks.
+
+    //! Applies the pending control requests.
+    void apply_controls();
+
+    //! Renders one block from the current position.
+    void render_block(AfBuffer& buffer, const ArenderConfig& config);
+
 public:
-    Sampler(const SamplePtr &sample, unsigned long output_sample_rate, Asfloatf gain = Asfloatf({ 1.0f, 1.0f }));
+    /*! Sampler constructor.
+     *  \param sample             sample to render.
+     *  \param output_sample_rate output sampling rate.
+     *  \param gain               left and right channel volumes, spread
+     *                            over every output channel through
+     *                            \ref Kernel::spread_gain().
+     *  \param frames             number of frames to preallocate the
+     *                            resampler output buffer for. This is
+     *                            also done by \ref configure() when the
+     *                            sampler is attached to a track.
+     *  \param max_speed          highest playing speed to allow through
+     *                            \ref set_speed(), or 0 to always play at
+     *                            the normal speed with the cheaper fixed
+     *                            rate resampler.
+     */
+    Sampler(
+        const SamplePtr &sample,
+        unsigned long output_sample_rate,
+        Asfloatf gain = Asfloatf({ 1.0f, 1.0f }),
+        size_t frames = 0,
+        double max_speed = 0.0
+    );
     virtual ~Sampler();
     virtual void drop();
+    virtual void configure(const ArenderConfig& config);
+    virtual bool set_gain(Afloat left, Afloat right);
+
+    /*! Sets the volume of a single output channel.
+     *  \return false if `channel` is not below \ref MAX_CHANNELS.
+     */
+    bool set_channel_gain(Achan channel, Afloat gain);
+
+    /*! Sets the loop of the sample.
+     *
+     *  Playback continues forward from the current position, and enters
+     *  the loop once it reaches `end`.
+     *
+     *  This function is wait-free and does not allocate. It must only be
+     *  called from one thread at a time, and the same goes for
+     *  \ref release() and \ref seek().
+     *
+     *  \param begin first frame of the loop.
+     *  \param end   frame after the last frame of the loop.
+     *  \param mode  `REPEAT` for a sustain loop, `ALTERNATING` for a
+     *               ping-pong loop, or `ONCE` to play through to the end
+     *               of the sample. The direction bit is ignored.
+     *  \return false if the loop does not fit in the sample or if the
+     *          request queue is full.
+     */
+    bool set_loop(size_t begin, size_t end, Loop::Mode mode = Loop::Mode::REPEAT);
+
+    /*! Leaves the loop and plays the rest of the sample forward.
+     *  \return false if the request queue is full.
+     */
+    bool release();
+
+    /*! Moves the playback position.
+     *
+     *  Audio already taken in by the resampler still plays out before the
+     *  new position is heard, the same way as at a loop point.
+     *
+     *  \return false if `frame` is past the end of the sample or if the
+     *          request queue is full.
+     */
+    bool seek(size_t frame);
+
+    //! \return next frame of the sample to be played, as of the last block.
+    inline size_t getPosition() const { return mPosition.load(std::memory_order_relaxed); }
+
+    /*! Sets the playing speed.
+     *
+     *  The sample plays `speed` times faster, and higher in pitch by as
+     *  many octaves as `log2(speed)`. The change is ramped smoothly over
+     *  the next rendered block.
+     *
+     *  This function is wait-free and can be called while the sampler
+     *  plays; the speed is read once at the start of each block.
+     *
+     *  \return false if the sampler was built without a maximum speed or
+     *          if `speed` is not between 0 and that maximum speed.
+     */
+    bool set_speed(double speed);
+
+    inline double getSpeed() const { return mSpeed.load(std::memory_order_relaxed); }
+
     virtual void make_active(void*);
     virtual bool is_active() const;
     virtual void render(AfBuffer& buffer, const ArenderConfig& config);
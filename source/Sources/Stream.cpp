@@ -0,0 +1,345 @@
+//  Stream.cpp :: Disk streaming sound source
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "Stream.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include "../AllocGuard.hpp"
+#include "../Kernels.hpp"
+#include "../soxr-0.1.1/src/soxr.h"
+#include "Sampler.hpp"
+
+namespace awe {
+namespace Source {
+
+Stream::Stream(
+    const std::string &file,
+    unsigned long output_sample_rate,
+    Asfloatf gain,
+    size_t prefetch_frames,
+    size_t chunk_frames,
+    size_t frames
+)   : mChannelGain      (gain)
+    , mFile             (nullptr)
+    , mInfo             ()
+    , mName             (file)
+    , mOutputSampleRate (output_sample_rate)
+    , mChunkFrames      (std::max<size_t>(chunk_frames, 64))
+    , mRing             ()
+    , mChunk            ()
+    , mInput            ()
+    , mScratch          ()
+    , mResampler        (nullptr)
+    , mRestarts         (16)
+    , mRetired          (32)
+    , mThread           ()
+    , mPollPeriod       (0)
+    , mStop             (true)
+    , mEnd              (true)
+    , mDone             (true)
+    , mUnderruns        (0)
+{
+    mFile = sf_open(file.c_str(), SFM_READ, &mInfo);
+
+    if (sf_error(mFile) != SF_ERR_NO_ERROR) {
+        fprintf(stderr, "libsndfile [error] %s: %s.\n", file.c_str(), sf_strerror(mFile));
+        sf_close(mFile);
+        mFile = nullptr;
+        return;
+    }
+
+    if (mInfo.channels > MAX_CHANNELS) {
+        fprintf(stderr, "libawe [error] %s: libawe supports at most %u channels.\n", file.c_str(), unsigned(MAX_CHANNELS));
+        sf_close(mFile);
+        mFile = nullptr;
+        return;
+    }
+
+    size_t const chan = mInfo.channels;
+
+    // Keep at least two chunks in flight so the I/O thread can refill
+    // one while the other is being rendered.
+    prefetch_frames = std::max(prefetch_frames, mChunkFrames * 2);
+
+    mRing   .reset (prefetch_frames * chan);
+    mChunk  .resize(mChunkFrames    * chan);
+    mInput  .resize(mChunkFrames    * chan);
+    mScratch.resize(frames          * chan);
+
+    // Wake up about four times per prefetch period to top up the ring.
+    mPollPeriod = std::chrono::microseconds(
+            std::max<long long>(1000, prefetch_frames * 250000LL / mInfo.samplerate));
+
+    mResampler = make_resampler();
+    mDone.store(false);
+    start();
+}
+
+Stream::~Stream()
+{
+    stop();
+    collect();
+
+    Restart restart;
+    while (mRestarts.read(&restart, 1) == 1)
+        if (restart.resampler != nullptr)
+            soxr_delete(restart.resampler);
+
+    if (mResampler != nullptr)
+        soxr_delete(mResampler);
+
+    if (mFile != nullptr)
+        sf_close(mFile);
+}
+
+::soxr* Stream::make_resampler()
+{
+    // !workaround See TODO in Sampler's SoXR::SoXR
+    if (static_cast<unsigned long>(mInfo.samplerate) == mOutputSampleRate)
+        return nullptr;
+
+    soxr_error_t              error  = nullptr;
+    soxr_io_spec_t      const soxIOs = soxr_io_spec(SOXR_FLOAT32_I, SOXR_FLOAT32_I);
+    soxr_quality_spec_t const soxQs  = soxr_quality_spec(SOXR_MQ, 0);
+    soxr_runtime_spec_t const soxRTs = soxr_runtime_spec(SoXR_threads);
+
+    ::soxr* const resampler = soxr_create(
+            static_cast<double>  (mInfo.samplerate),    // Input rate
+            static_cast<double>  (mOutputSampleRate),   // Output rate
+            static_cast<unsigned>(mInfo.channels),      // Channel Count
+            &error, &soxIOs, &soxQs, &soxRTs
+            );
+    if (error) { throw std::runtime_error(error); }
+
+    error = soxr_set_input_fn(resampler, (soxr_input_fn_t) input_fn, this, mChunkFrames);
+    if (error) {
+        soxr_delete(resampler);
+        throw std::runtime_error(error);
+    }
+
+    return resampler;
+}
+
+void Stream::collect()
+{
+    ::soxr* resampler;
+    while (mRetired.read(&resampler, 1) == 1)
+        soxr_delete(resampler);
+}
+
+bool Stream::fetch()
+{
+    if (mEnd.load(std::memory_order_relaxed) || mRing.space() < mChunk.size())
+        return false;
+
+    sf_count_t const frames = sf_readf_float(mFile, mChunk.data(), mChunkFrames);
+
+    if (frames > 0)
+        mRing.write(mChunk.data(), frames * mInfo.channels);
+
+    // Publish the end of file only after its last chunk is in the ring.
+    if (frames < static_cast<sf_count_t>(mChunkFrames)) {
+        mEnd.store(true, std::memory_order_release);
+        return false;
+    }
+
+    return true;
+}
+
+void Stream::work()
+{
+    while (mStop.load() == false)
+    {
+        if (fetch())
+            continue;
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCond.wait_for(lock, mPollPeriod, [this] { return mStop.load(); });
+    }
+}
+
+void Stream::start()
+{
+    if (mFile == nullptr)
+        return;
+
+    mEnd .store(false);
+    mStop.store(false);
+
+    // Prefetch on the calling thread so that the first blocks do not
+    // depend on how soon the I/O thread gets scheduled.
+    while (fetch());
+
+    mRing.reset_counters();
+    mUnderruns.store(0);
+
+    mThread = std::thread(&Stream::work, this);
+}
+
+void Stream::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop.store(true);
+    }
+    mCond.notify_all();
+
+    if (mThread.joinable())
+        mThread.join();
+}
+
+void Stream::drop()
+{
+    stop();
+
+    // Nothing more is coming, so a pending restart only plays out what
+    // was prefetched for it.
+    mEnd .store(true);
+    mDone.store(true);
+}
+
+bool Stream::set_gain(Afloat left, Afloat right) {
+    mChannelGain[0] = left;
+    mChannelGain[1] = right;
+    return true;
+}
+
+void Stream::configure(const ArenderConfig& config)
+{
+    if (mScratch.size() < config.frameCount * mInfo.channels)
+        mScratch.resize(config.frameCount * mInfo.channels);
+}
+
+void Stream::make_active(void*)
+{
+    if (mFile == nullptr)
+        return;
+
+    collect();
+
+    ::soxr* const resampler = make_resampler();
+
+    stop();
+
+    // The render thread may still be reading the old stream out of the
+    // ring, so leave it alone and only mark where the new stream begins.
+    // With the I/O thread stopped, this thread is the only producer.
+    // Clear the end of file first so that a restart applied before the
+    // new stream arrives waits for it instead of finishing.
+    Restart const restart = { mRing.written(), resampler };
+    mEnd.store(false, std::memory_order_release);
+
+    if (mRestarts.write(&restart, 1) != 1) {
+        fprintf(stderr, "libawe [error] %s: too many pending restarts.\n", mName.c_str());
+        if (restart.resampler != nullptr)
+            soxr_delete(restart.resampler);
+        start();
+        return;
+    }
+
+    sf_seek(mFile, 0, SEEK_SET);
+    start();
+}
+
+void Stream::apply_restarts()
+{
+    Restart restart;
+    while (mRestarts.read(&restart, 1) == 1)
+    {
+        mRing.discard(restart.position);
+
+        // Hand the old resampler back to be deleted off the render thread.
+        if (mResampler != nullptr)
+            mRetired.write(&mResampler, 1);
+
+        mResampler = restart.resampler;
+        mDone.store(false, std::memory_order_release);
+    }
+}
+
+bool Stream::is_active() const
+{
+    return mDone.load(std::memory_order_acquire) == false || mRestarts.empty() == false;
+}
+
+size_t Stream::input_fn(void* data, const void** buffer, size_t frames)
+{
+    Stream* const s = static_cast<Stream*>(data);
+    size_t  const chan = s->mInfo.channels;
+
+    frames = std::min(frames, s->mChunkFrames);
+    *buffer = s->mInput.data();
+
+    // Check for the end of file before reading so that a short read
+    // after it is not mistaken for an underrun.
+    bool   const end  = s->mEnd.load(std::memory_order_acquire);
+    size_t const read = s->mRing.read(s->mInput.data(), frames * chan) / chan;
+
+    if (read == frames || end)
+        return read; // A zero-length read at the end flushes the resampler.
+
+    // Keep the resampler fed with silence until the I/O thread catches up.
+    s->mUnderruns.fetch_add(1, std::memory_order_relaxed);
+    std::fill(s->mInput.begin() + read * chan, s->mInput.begin() + frames * chan, 0.0f);
+    return frames;
+}
+
+void Stream::render(AfBuffer& buffer, const ArenderConfig& config)
+{
+    AallocGuard guard;
+
+    apply_restarts();
+
+    if (mDone.load(std::memory_order_relaxed))
+        return;
+
+    if (config.quality == ArenderConfig::Quality::SKIP)
+        return;
+
+    // Preallocated by configure(); see AallocGuard.
+    if (mScratch.size() < config.frameCount * mInfo.channels)
+        mScratch.resize(config.frameCount * mInfo.channels);
+
+    size_t frames;
+
+    if (mResampler != nullptr)
+    {
+        frames = soxr_output(mResampler, mScratch.data(), config.frameCount);
+
+        soxr_error_t const error = soxr_error(mResampler);
+        if (error) { throw std::runtime_error(error); }
+
+        // The resampler only comes up short once it has been flushed.
+        if (frames < config.frameCount)
+            mDone.store(true, std::memory_order_release);
+    }
+    else
+    {
+        bool const end = mEnd.load(std::memory_order_acquire);
+
+        frames = mRing.read(mScratch.data(), config.frameCount * mInfo.channels) / mInfo.channels;
+
+        if (frames < config.frameCount) {
+            if (end)
+                mDone.store(true, std::memory_order_release);
+            else
+                mUnderruns.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (config.quality == ArenderConfig::Quality::MUTE)
+        return;
+
+    assert(config.channels <= MAX_CHANNELS);
+
+    Afloat gain[MAX_CHANNELS];
+    Kernel::spread_gain(gain, config.channels, mChannelGain[0], mChannelGain[1]);
+
+    Afloat* const dst = buffer.data() + config.frameOffset * config.channels;
+    Kernel::mix_f32(dst, config.channels, mScratch.data(), static_cast<Achan>(mInfo.channels), frames, gain);
+}
+
+}
+}
@@ -0,0 +1,178 @@
+//  Stream.hpp :: Disk streaming sound source
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef SOURCE_STREAM_H
+#define SOURCE_STREAM_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <sndfile.h>
+
+#include "../Frame.hpp"
+#include "../RingBuffer.hpp"
+#include "../Source.hpp"
+
+struct soxr;
+
+namespace awe {
+namespace Source {
+
+/*! Sound source that streams a sound file from disk.
+ *
+ *  Unlike \ref Sampler, which plays an \ref awe::Asample decoded into
+ *  memory in full, this source decodes the file in chunks of
+ *  `chunk_frames` frames on a background I/O thread into a preallocated
+ *  \ref awe::ARingBuffer holding `prefetch_frames` frames. The resident
+ *  footprint of a stream is therefore bounded by its prefetch depth
+ *  regardless of the length of the file, which makes it the preferred
+ *  source for long backing tracks.
+ *
+ *  \ref render() only reads from the ring buffer and never waits on the
+ *  I/O thread. If the I/O thread falls behind, the missing part of the
+ *  block is rendered as silence and counted in \ref getUnderruns().
+ *  Streams that are not at the output sampling rate are resampled with
+ *  libsoxr on the render thread.
+ *
+ *  \ref make_active() never touches what the render thread is using.
+ *  It restarts the I/O thread at the beginning of the file and posts a
+ *  request, along with a freshly created resampler, which \ref render()
+ *  picks up at the start of its next block to drop the frames left over
+ *  from the old stream.
+ */
+class Stream : public awe::Asource
+{
+public:
+    Asfloatf        mChannelGain;           //!< Channel volumes.
+
+private:
+    SNDFILE       * mFile;                  //!< libsndfile file handle
+    SF_INFO         mInfo;                  //!< libsndfile file format description
+    std::string     mName;                  //!< Path to sound file
+
+    unsigned long   mOutputSampleRate;      //!< Output sampling rate.
+    size_t          mChunkFrames;           //!< Number of frames decoded per read.
+
+    AfRingBuffer    mRing;                  //!< Decoded frames waiting to be rendered.
+    AfBuffer        mChunk;                 //!< Decoder output buffer, owned by the I/O thread.
+    AfBuffer        mInput;                 //!< Resampler input buffer, owned by the render thread.
+    AfBuffer        mScratch;               //!< Render output buffer, reused across blocks.
+
+    ::soxr        * mResampler;             //!< Resampler, or null if at output rate.
+
+    //! Restart request posted by \ref make_active() to the render thread.
+    struct Restart
+    {
+        size_t  position;   //!< Ring position the restarted stream begins at
+        ::soxr* resampler;  //!< Fresh resampler to switch to
+    };
+
+    ARingBuffer<Restart>    mRestarts;      //!< Restarts not applied yet, owned by the control thread.
+    ARingBuffer< ::soxr* >  mRetired;       //!< Resamplers to be deleted, owned by the render thread.
+
+    std::thread             mThread;        //!< Background I/O thread
+    std::mutex              mMutex;
+    std::condition_variable mCond;
+    std::chrono::microseconds mPollPeriod;  //!< Time between ring buffer refills
+
+    std::atomic<bool>       mStop;          //!< I/O thread shut down flag
+    std::atomic<bool>       mEnd;           //!< Whole file has been written into the ring
+    std::atomic<bool>       mDone;          //!< Whole file has been rendered
+    std::atomic<size_t>     mUnderruns;     //!< Number of blocks rendered short
+
+    //! Decodes one chunk into the ring buffer.
+    //! \return false if the ring is full or the end of file was reached.
+    bool fetch();
+
+    //! I/O thread main loop.
+    void work();
+
+    //! Starts the I/O thread after filling the ring buffer.
+    void start();
+
+    //! Stops the I/O thread.
+    void stop();
+
+    //! Creates a resampler, or returns null if at output rate.
+    ::soxr* make_resampler();
+
+    //! Deletes the resamplers handed back by the render thread.
+    void collect();
+
+    //! Applies pending restart requests; called from \ref render().
+    void apply_restarts();
+
+    //! Feeds the resampler from the ring buffer.
+    static size_t input_fn(void* data, const void** buffer, size_t frames);
+
+public:
+    /*! Opens a sound file for streaming and starts prefetching it.
+     *
+     *  \warning This function leaves the stream inactive if it fails to
+     *           open the file; check \ref is_open().
+     *
+     *  \param file               path to sound file.
+     *  \param output_sample_rate output sampling rate.
+     *  \param gain               channel volumes.
+     *  \param prefetch_frames    number of frames to decode ahead of the
+     *                            render position.
+     *  \param chunk_frames       number of frames decoded per disk read.
+     *  \param frames             number of frames to preallocate the
+     *                            render buffers for. This is also done by
+     *                            \ref configure() when the stream is
+     *                            attached to a track.
+     */
+    Stream(
+        const std::string &file,
+        unsigned long output_sample_rate,
+        Asfloatf gain = Asfloatf({ 1.0f, 1.0f }),
+        size_t prefetch_frames = IO_BUFFER_SIZE,
+        size_t chunk_frames = 4096,
+        size_t frames = 0
+    );
+
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    virtual ~Stream();
+
+    //! Stops streaming; the stream stays inactive until \ref make_active().
+    virtual void drop();
+    virtual void configure(const ArenderConfig& config);
+    virtual bool set_gain(Afloat left, Afloat right);
+
+    //! Restarts streaming from the beginning of the file.
+    //! The restart takes effect at the next rendered block.
+    virtual void make_active(void*);
+    virtual bool is_active() const;
+    virtual void render(AfBuffer& buffer, const ArenderConfig& config);
+
+    inline bool          is_open        () const { return mFile != nullptr; }
+    inline Achan         getChannelCount() const { return mInfo.channels; }
+    inline size_t        getFrameCount  () const { return mInfo.frames; }
+    inline unsigned long getSampleRate  () const { return mInfo.samplerate; }
+    inline std::string   getName        () const { return mName; }
+
+    //!\name Prefetch statistics
+    //!\{
+
+    //! \return number of frames decoded ahead of the render position.
+    inline size_t getBufferFill    () const { return is_open() ? mRing.size()      / mInfo.channels : 0; }
+    //! \return number of frames that can be decoded ahead.
+    inline size_t getBufferCapacity() const { return is_open() ? mRing.capacity()  / mInfo.channels : 0; }
+    //! \return lowest number of frames left in the ring after a render.
+    inline size_t getBufferLowWater() const { return is_open() ? mRing.low_water() / mInfo.channels : 0; }
+    //! \return number of blocks that were rendered short of data.
+    inline size_t getUnderruns     () const { return mUnderruns.load(std::memory_order_relaxed); }
+
+    //!\}
+};
+
+}
+}
+
+#endif
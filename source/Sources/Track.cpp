@@ -3,42 +3,536 @@
 
 #include "Track.hpp"
 
+#include <algorithm>
+#include "../Kernels.hpp"
+
 namespace awe {
 namespace Source {
 
-void Track::fpull(AsourcePointer src)
+std::atomic<unsigned long> Track::sTopologyEpoch(0);
+
+namespace {
+
+//! Unity gain on every channel, for mixing a track into its target.
+Afloat const sUnityGain[MAX_CHANNELS] = {
+    1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f,
+    1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f,
+    1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f,
+    1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f
+};
+
+static_assert(MAX_CHANNELS == 32, "sUnityGain must have MAX_CHANNELS entries.");
+
+//! Checks a track channel count before anything is allocated for it.
+Achan check_channels(Achan channels)
+{
+    if (channels < 1 || channels > MAX_CHANNELS)
+        throw std::runtime_error("libawe [exception] Track: unsupported channel count.");
+
+    return channels;
+}
+
+//! Creates a filter rack for `channels` channels.
+template< Achan C >
+std::shared_ptr<AfilterBase> make_rack(Achan channels)
+{
+    return channels == C
+        ? std::make_shared< Filter::Rack<C> >()
+        : make_rack<C + 1>(channels);
+}
+
+template<>
+std::shared_ptr<AfilterBase> make_rack<MAX_CHANNELS + 1>(Achan)
+{
+    return nullptr;
+}
+
+}
+
+bool Track::fpull(const AsourcePointer &src, const ArenderConfig &config)
+{
+    if (src->is_active() == false || fskip(src) == true)
+        return false;
+
+    {
+        Aprofiler::Scope scope(Aprofiler::Kind::SOURCE, src.get(), config.frameCount);
+        AallocGuard guard;
+        src->render(mPbuffer, config);
+    }
+
+    fdirty(config.frameOffset + config.frameCount);
+
+    return src->is_active();
+}
+
+void Track::fpull(const AsourcePointer &src, const ArenderConfig &config, uint64_t begin, uint64_t end)
+{
+    if (begin >= end || src->is_active() == false)
+        return;
+
+    ArenderConfig part = config;
+    part.frameOffset += begin - mPclock;
+    part.frameCount   = end - begin;
+
+    {
+        Aprofiler::Scope scope(Aprofiler::Kind::SOURCE, src.get(), part.frameCount);
+        AallocGuard guard;
+        src->render(mPbuffer, part);
+    }
+
+    fdirty(part.frameOffset + part.frameCount);
+}
+
+bool Track::fskip(const AsourcePointer &src) const
+{
+    if (mPheld.empty() && mPsplit.empty())
+        return false;
+
+    return std::find(mPheld .begin(), mPheld .end(), src) != mPheld .end()
+        || std::find(mPsplit.begin(), mPsplit.end(), src) != mPsplit.end();
+}
+
+void Track::fpull(const ArenderConfig &config)
+{
+    Aprofiler::TrackScope profile(this, mName);
+
+    mPcurrent = facquire();
+
+    fcollect(config);
+
+    size_t active = 0;
+
+    if (fpull_parallel(config, active) == false) {
+        for(const AsourcePointer &src : mPcurrent->sources)
+            active += fpull(src, config) ? 1 : 0;
+    }
+
+    active += fevents(config);
+
+    mPcurrent->active.store(active, std::memory_order_release);
+
+    frelease();
+    mPcurrent = nullptr;
+
+    mPclock += config.frameCount;
+}
+
+void Track::fcollect(const ArenderConfig &config)
+{
+    uint64_t const end = mPclock + config.frameCount;
+
+    // Capacity was reserved by fschedule(), so this does not allocate.
+    while (mPevents.empty() == false && mPevents.back().frame < end)
+    {
+        const AsourcePointer &src = mPevents.back().source;
+        if (std::find(mPsplit.begin(), mPsplit.end(), src) == mPsplit.end())
+            mPsplit.push_back(src);
+
+        mPdue.push_back(mPevents.back());
+        mPevents.pop_back();
+    }
+}
+
+size_t Track::fevents(const ArenderConfig &config)
+{
+    uint64_t const begin = mPclock;
+    uint64_t const end   = mPclock + config.frameCount;
+
+    size_t active = 0;
+
+    for(const AsourcePointer &src : mPsplit)
+    {
+        bool     running = std::find(mPheld.begin(), mPheld.end(), src) == mPheld.end();
+        uint64_t pos     = begin;
+
+        // Render the source up to each of its events, then apply it.
+        for(const Event &event : mPdue)
+        {
+            if (event.source != src)
+                continue;
+
+            uint64_t const at = std::max(event.frame, begin);
+
+            if (running)
+                fpull(src, config, pos, at);
+
+            pos = at;
+
+            switch (event.type)
+            {
+            case Event::Type::START: running = true;  break;
+            case Event::Type::STOP:  running = false; break;
+            case Event::Type::GAIN:  src->set_gain(event.gainL, event.gainR); break;
+            }
+        }
+
+        if (running)
+            fpull(src, config, pos, end);
+
+        auto const held = std::find(mPheld.begin(), mPheld.end(), src);
+
+        /****/ if (running == true  && held != mPheld.end()) {
+            mPheld.erase(held);
+        } else if (running == false && held == mPheld.end()) {
+            mPheld.push_back(src);
+        }
+
+        if (src->is_active())
+            active++;
+    }
+
+    // Stopped sources are still counted while they are active.
+    for(const AsourcePointer &src : mPheld)
+        if (std::find(mPsplit.begin(), mPsplit.end(), src) == mPsplit.end() && src->is_active())
+            active++;
+
+    if (mPsplit.empty() == false)
+        fpending();
+
+    mPdue  .clear();
+    mPsplit.clear();
+
+    return active;
+}
+
+void Track::fschedule(const Event &event)
+{
+    // Keep the list sorted latest first, after events at the same frame.
+    auto const pos = std::lower_bound(mPevents.begin(), mPevents.end(), event.frame,
+            [](const Event &e, uint64_t frame) { return e.frame > frame; });
+
+    mPevents.insert(pos, event);
+
+    // Make sure that the render path never has to grow these.
+    mPdue  .reserve(mPevents .size());
+    mPsplit.reserve(mPevents .size());
+    mPheld .reserve(mPsources.size());
+
+    fpending();
+}
+
+void Track::fpending()
+{
+    mPpending.store(mPevents.size() + mPheld.size(), std::memory_order_release);
+}
+
+const Track::Snapshot* Track::facquire() const
+{
+    // A writer only deletes a replaced snapshot after seeing no readers,
+    // and a reader that registers after that sees the new snapshot.
+    mPreaders.fetch_add(1);
+    return mPsnapshot.load();
+}
+
+void Track::frelease() const
+{
+    mPreaders.fetch_sub(1);
+}
+
+void Track::fpublish(AsourceList sources, const AsourcePointer &attached)
+{
+    const Snapshot* const current = mPsnapshot.load();
+
+    // Sources that may be rendering right now are not queried; the count
+    // is carried over and corrected by the next pull.
+    size_t active = current->active.load(std::memory_order_acquire);
+    if (attached && attached->is_active())
+        active += 1;
+
+    Snapshot* const snapshot = new Snapshot();
+    snapshot->sources.swap(sources);
+    snapshot->active.store(std::min(active, snapshot->sources.size()));
+
+    mPretired.push_back(mPsnapshot.exchange(snapshot));
+    sTopologyEpoch.fetch_add(1, std::memory_order_acq_rel);
+
+    freclaim();
+}
+
+void Track::freclaim()
+{
+    if (mPretired.empty() || mPreaders.load() != 0)
+        return;
+
+    for(const Snapshot* snapshot : mPretired)
+        delete snapshot;
+
+    mPretired.clear();
+}
+
+void Track::attach_source(AsourcePointer src)
 {
-    if (src->is_active() == true)
-        src->render(mPbuffer, mPconfig);
+    // Let the source allocate its working memory before it can be
+    // reached from the render path. getConfig() copies the configuration
+    // under the pool mutex, so a concurrent setConfig() cannot tear it.
+    src->configure(getConfig());
+
+    MutexLockGuard c_lock(mCmutex);
+
+    if (mPsources.insert(src).second) {
+        AsourceList sources = mPsnapshot.load()->sources;
+        sources.push_back(src);
+        fpublish(std::move(sources), src);
+    }
+
+    mqActive.store(true);
+}
+
+bool Track::detach_source(AsourcePointer src)
+{
+    MutexLockGuard c_lock(mCmutex);
+
+    bool const r = mPsources.erase(src) != 0;
+
+    if (r) {
+        AsourceList sources = mPsnapshot.load()->sources;
+        sources.erase(std::find(sources.begin(), sources.end(), src));
+
+        // Only the render path consumes events and stopped states while
+        // the source list mutex is held, so none can show up now.
+        if (mPpending.load(std::memory_order_acquire) == 0) {
+            fpublish(std::move(sources), nullptr);
+        } else {
+            // Drop its stopped state and pending events as well, in the
+            // same pull as the source itself.
+            MutexLockGuard p_lock(mPmutex);
+
+            mPheld.erase(std::remove(mPheld.begin(), mPheld.end(), src), mPheld.end());
+            mPevents.erase(std::remove_if(mPevents.begin(), mPevents.end(),
+                        [&src](const Event &e) { return e.source == src; }), mPevents.end());
+            fpending();
+
+            fpublish(std::move(sources), nullptr);
+        }
+    }
+
+    mqActive.store(mPsources.empty() == false);
+    return r;
 }
 
-void Track::fpull()
+void Track::schedule_start(AsourcePointer src, uint64_t frame)
 {
-    for(AsourcePointer src: mPsources)
-        fpull(src);
+    bool attached;
+    {
+        MutexLockGuard c_lock(mCmutex);
+        attached = mPsources.count(src) != 0;
+    }
+
+    // See attach_source().
+    if (attached == false)
+        src->configure(getConfig());
+
+    MutexLockGuard c_lock(mCmutex);
+    MutexLockGuard p_lock(mPmutex);
+
+    // Hold the source before it can be reached from the render path.
+    bool const attach = mPsources.insert(src).second;
+    if (attach)
+        mPheld.push_back(src);
+
+    fschedule({ frame, Event::Type::START, src, 0.0f, 0.0f });
+
+    if (attach) {
+        AsourceList sources = mPsnapshot.load()->sources;
+        sources.push_back(src);
+        fpublish(std::move(sources), src);
+    }
+
+    mqActive.store(true);
+}
+
+void Track::schedule_stop(AsourcePointer src, uint64_t frame)
+{
+    MutexLockGuard c_lock(mCmutex);
+    MutexLockGuard p_lock(mPmutex);
+
+    if (mPsources.count(src) != 0)
+        fschedule({ frame, Event::Type::STOP, src, 0.0f, 0.0f });
 }
 
-void Track::fflip()
+void Track::schedule_gain(AsourcePointer src, uint64_t frame, Afloat left, Afloat right)
 {
-    auto s = mObuffer.size();
-    mObuffer.clear();
-    mObuffer.resize(s);
+    MutexLockGuard c_lock(mCmutex);
+    MutexLockGuard p_lock(mPmutex);
+
+    if (mPsources.count(src) != 0)
+        fschedule({ frame, Event::Type::GAIN, src, left, right });
+}
+
+bool Track::fpull_parallel(const ArenderConfig &config, size_t &active)
+{
+    if (!mPpool)
+        return false;
+
+    size_t const sources = mPcurrent->sources.size();
+    size_t const tasks   = std::min(mPscratch.size(), sources / mPgrain);
+
+    if (tasks < 2)
+        return false;
+
+    // Render sources into per-task scratch buffers.
+    ATaskGroup group;
+
+    for(size_t t = 0; t < tasks; t++)
+    {
+        PullTask &task = mPtasks[t];
+        task.track  = this;
+        task.begin  = sources *  t      / tasks;
+        task.end    = sources * (t + 1) / tasks;
+        task.target = &mPscratch[t];
+        task.source = nullptr;
+        task.active = 0;
+        task.config = &config;
+
+        mPpool->submit(group, &Track::pull_task, &task);
+    }
+
+    mPpool->wait(group);
+
+    for(size_t t = 0; t < tasks; t++)
+        active += mPtasks[t].active;
+
+    // Sum scratch buffers pairwise; each level halves the buffer count.
+    for(size_t stride = 1; stride < tasks; stride *= 2)
+    {
+        ATaskGroup level;
+
+        for(size_t t = 0; t + stride < tasks; t += 2 * stride)
+        {
+            mPtasks[t].source = &mPscratch[t + stride];
+            mPpool->submit(level, &Track::reduce_task, &mPtasks[t]);
+        }
+
+        mPpool->wait(level);
+    }
+
+    // Mix the sum into the pool buffer.
+    mPtasks[0].target = &mPbuffer;
+    mPtasks[0].source = &mPscratch[0];
+    reduce_task(&mPtasks[0]);
+
+    fdirty(config.frameOffset + config.frameCount);
+
+    return true;
+}
+
+void Track::pull_task(void* ptr)
+{
+    PullTask &task = *static_cast<PullTask*>(ptr);
+    ArenderConfig const &config = *task.config;
+
+    Aprofiler::TrackScope profile(task.track, task.track->mName);
+
+    Achan   const channels = task.track->mChannels;
+    Afloat* const begin = task.target->data() +  config.frameOffset * channels;
+    Afloat* const end   = begin + config.frameCount * channels;
+    std::fill(begin, end, 0.0f);
+
+    for(size_t i = task.begin; i < task.end; i++)
+    {
+        const AsourcePointer &src = task.track->mPcurrent->sources[i];
+        if (src->is_active() == true && task.track->fskip(src) == false) {
+            {
+                Aprofiler::Scope scope(Aprofiler::Kind::SOURCE, src.get(), config.frameCount);
+                AallocGuard guard;
+                src->render(*task.target, config);
+            }
+
+            if (src->is_active())
+                task.active++;
+        }
+    }
+}
+
+void Track::reduce_task(void* ptr)
+{
+    PullTask &task = *static_cast<PullTask*>(ptr);
+    ArenderConfig const &config = *task.config;
+
+    Achan  const channels = task.track->mChannels;
+    size_t const begin = config.frameOffset * channels;
+    size_t const end   = begin + config.frameCount * channels;
+
+    Afloat      * dst = task.target->data();
+    Afloat const* src = task.source->data();
+
+    for(size_t i = begin; i < end; i++)
+        dst[i] += src[i];
+}
+
+void Track::setThreadPool(AthreadPoolPtr pool, size_t grain)
+{
+    MutexLockGuard p_lock(mPmutex);
+
+    mPpool  = pool;
+    mPgrain = std::max<size_t>(grain, 1);
+
+    // The calling thread helps out, so there can be one more task than
+    // there are workers.
+    size_t const tasks = pool ? pool->size() + 1 : 0;
+
+    mPscratch.assign(tasks, AfBuffer(mPbuffer.size(), 0.f));
+    mPtasks  .resize(tasks);
+}
+
+void Track::fflip(const ArenderConfig &config)
+{
+    // The output buffer becomes the next pool buffer; clear only what was
+    // written into it, as the rest is still silent.
+    std::fill(mObuffer.begin(), mObuffer.begin() + mOdirty * mChannels, 0.0f);
     mObuffer.swap(mPbuffer);
+
+    mOdirty  = mPdirty;
+    mOframes = config.frameCount;
+    mPdirty  = 0;
 }
 
 void Track::ffilter()
 {
-    mOfilter.filter_buffer(mObuffer);
+    if (mOfilter->is_bypassed())
+        return;
+
+    Aprofiler::TrackScope profile(this, mName);
+    mOfilter->filter_frames(mObuffer, mOframes);
+
+    // Filters may write anywhere in the block, even over silence.
+    mOdirty = std::max(mOdirty, mOframes);
 }
 
 
-Track::Track(size_t sample_rate, size_t frames, std::string name)
+Track::Track(size_t sample_rate, size_t frames, std::string name, size_t workers, size_t grain, Achan channels)
     : mName   (name)
-    , mPconfig(sample_rate, frames)
-    , mPbuffer(2 * frames, 0.f)
-    , mObuffer(2 * frames, 0.f)
+    , mChannels(check_channels(channels))
+    , mPconfig(sample_rate, frames, 0, ArenderConfig::Quality::DEFAULT, channels)
+    , mPsnapshot(new Snapshot())
+    , mPreaders (0)
+    , mPcurrent (nullptr)
+    , mPpool  (nullptr)
+    , mPgrain (grain)
+    , mPbuffer(channels * frames, 0.f)
+    , mObuffer(channels * frames, 0.f)
+    , mPdirty (0)
+    , mOdirty (0)
+    , mOframes(0)
+    , mPclock (0)
+    , mPpending(0)
     , mqActive(true)
-{ }
+    , mOprepared(false)
+{
+    mOfilter = make_rack<1>(channels);
+    mOfilter->prepare(frames);
+
+    if (workers != 0)
+        setThreadPool(std::make_shared<AThreadPool>(workers), grain);
+}
+
+Track::~Track()
+{
+    for(const Snapshot* snapshot : mPretired)
+        delete snapshot;
+
+    delete mPsnapshot.load();
+}
 
 void Track::render(AfBuffer &targetBuffer, const ArenderConfig &targetConfig)
 {
@@ -47,33 +541,81 @@ void Track::render(AfBuffer &targetBuffer, const ArenderConfig &targetConfig)
 
     std::lock(mPmutex, mOmutex);
 
+    // A parent track may render this one over part of its block.
+    unsigned long const frameCount = std::min(targetConfig.frameCount, mPconfig.frameCount);
+
     size_t a = 0, p = targetConfig.frameOffset;
-    size_t const  q = targetConfig.frameOffset + mPconfig.frameCount;
+    size_t const  q = targetConfig.frameOffset + frameCount;
 
     MutexLockGuard o_lock(mOmutex, std::adopt_lock);
-    {
-        // Unlock pool mutex immediately after mixing.
-        MutexLockGuard p_lock(mPmutex, std::adopt_lock);
-        fpull();
-        fflip();
-    }
 
-    ffilter();
+    size_t count = q - p;
+
+    if (mOprepared.load(std::memory_order_acquire)) {
+        // Output was prepared ahead of time for the whole block of the
+        // parent; only mix in the part the parent asked for. The parent
+        // may render this track over several parts of its block, or this
+        // track may have several parents.
+        mPmutex.unlock();
+
+        a     = p;
+        count = (a < mOdirty) ? std::min(count, mOdirty - a) : 0;
+    } else {
+        {
+            // Unlock pool mutex immediately after mixing.
+            MutexLockGuard p_lock(mPmutex, std::adopt_lock);
+
+            ArenderConfig config = mPconfig;
+            config.frameCount = frameCount;
+            fpull(config);
+            fflip(config);
+        }
+
+        ffilter();
+    }
 
     if (targetConfig.quality == ArenderConfig::Quality::MUTE)
         return;
 
-    AfBuffer::const_pointer src = mObuffer.data();
-    AfBuffer::      pointer dst = targetBuffer.data();
+    // Nothing to mix in.
+    if (mOdirty == 0 || count == 0)
+        return;
+
+    Kernel::mix_f32(
+            targetBuffer.data() + p * targetConfig.channels, targetConfig.channels,
+            mObuffer.data()     + a * mChannels,             mChannels,
+            count, sUnityGain
+    );
+}
+
+bool Track::try_render(Afloat* target, size_t frames)
+{
+    if (frames * mChannels > mPbuffer.size())
+        return false;
+
+    // Never wait on a control thread; drop the block instead.
+    if (std::try_lock(mPmutex, mOmutex) != -1)
+        return false;
 
-    while(p < q)
+    MutexLockGuard o_lock(mOmutex, std::adopt_lock);
     {
-        dst[p*2  ] += src[a*2  ];
-        dst[p*2+1] += src[a*2+1];
+        MutexLockGuard p_lock(mPmutex, std::adopt_lock);
 
-        p += 1;
-        a += 1;
+        // Render only as many frames as the device asked for.
+        ArenderConfig config = mPconfig;
+        config.frameCount = frames;
+        fpull(config);
+        fflip(config);
     }
+
+    ffilter();
+
+    if (mOdirty == 0)
+        std::fill(target, target + frames * mChannels, 0.0f);
+    else
+        std::copy(mObuffer.begin(), mObuffer.begin() + frames * mChannels, target);
+
+    return true;
 }
 
 }
@@ -4,12 +4,20 @@
 #ifndef AWE_SOURCE_TRACK_H
 #define AWE_SOURCE_TRACK_H
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <stdexcept>
 #include <string>
+#include <vector>
+#include "../AllocGuard.hpp"
 #include "../Define.hpp"
+#include "../Profiler.hpp"
+#include "../RingBuffer.hpp"
 #include "../Source.hpp"
+#include "../ThreadPool.hpp"
 #include "../Filters/Rack.hpp"
 
 namespace awe {
@@ -21,54 +29,241 @@ namespace Source {
  *  output track. Filters can be chained to the filter rack to apply
  *  post-mixing sound effects.
  *
+ *  A track mixes any number of interleaved channels, up to
+ *  \ref MAX_CHANNELS, fixed at construction. The channel count is passed
+ *  on to its sources through `ArenderConfig::channels`, and its filter
+ *  rack is a \ref Filter::Rack of the same channel count (see
+ *  \ref getRack()). A track mixed into a parent track of another channel
+ *  count is mapped the same way as a sample; see \ref Kernel::mix_f32().
+ *
  *  All tracks are double-buffered; the internal inaccessible source
- *  mixing pool is labelled P while the output pool is labelled O.
+ *  mixing pool is labelled P while the output pool is labelled O. The
+ *  buffers are swapped on every flip, and each buffer remembers how many
+ *  frames have been written into it, so that only those are cleared
+ *  before it is mixed into again. A block that no source rendered into
+ *  and no filter ran over is silent, and is not mixed into the parent.
+ *
+ *  Every track has three mutexes; one is used to lock the pool buffer,
+ *  event queue and pool config, another is used to to lock the output
+ *  buffer and filter rack, and the last one serializes changes to the
+ *  source list between control threads.
+ *
+ *  The render path never waits on the source list. It reads an immutable
+ *  snapshot of the source array, and \ref attach_source() and
+ *  \ref detach_source() publish a new snapshot atomically instead of
+ *  editing it in place. Replaced snapshots are deleted by a later edit
+ *  once no thread is reading them, so a detached source is released on
+ *  the control thread rather than inside a pull. The number of active
+ *  sources is stored with the snapshot by every pull.
+ *
+ *  A track can pull its sources in parallel on a \ref awe::AThreadPool.
+ *  The source list is split into tasks of at least `grain` sources,
+ *  each task mixes its sources into its own scratch buffer, and the
+ *  scratch buffers are summed pairwise into the pool buffer. Sources
+ *  attached to a parallel track must not share mutable state with each
+ *  other.
  *
- *  Every track has two mutexes; one is used to lock the pool buffer,
- *  source list and pool config and the other is used to to lock the
- *  output buffer and filter rack.
+ *  Sources can be started, stopped and have their volume changed at an
+ *  exact frame through the event queue (see \ref schedule_start()).
+ *  Frames are counted by the track clock (\ref getClock()), which
+ *  advances by one block on every pull. Only the sources with events
+ *  inside a block are split; each of them is rendered over the part of
+ *  the block in which it is running, using `frameOffset` and
+ *  `frameCount`, while all other sources render the whole block at once.
  */
 class Track : public Asource
 {
     using MutexLockGuard = std::lock_guard< std::mutex >;
     using AscRack        = Filter::Rack<2>;
+    using ArackPointer   = std::shared_ptr< AfilterBase >;
     using AsourcePointer = std::shared_ptr< Asource >;
     using AsourceSet     = std::set< AsourcePointer >;
+    using AsourceList    = std::vector< AsourcePointer >;
+    using AthreadPoolPtr = std::shared_ptr< AThreadPool >;
+
+    //! Parallel pull task parameters.
+    struct PullTask
+    {
+        Track         * track;  //!< Track being pulled
+        size_t          begin;  //!< Index of first source to render
+        size_t          end;    //!< Index past last source to render
+        AfBuffer      * target; //!< Scratch buffer to render into
+        AfBuffer const* source; //!< Scratch buffer to sum into target
+        size_t          active; //!< Number of rendered sources still active
+
+        ArenderConfig const* config;    //!< Block being pulled
+    };
+
+    //! Immutable source list read by the render path.
+    struct Snapshot
+    {
+        AsourceList                 sources;    //!< Sound sources to mix from
+        mutable std::atomic<size_t> active;     //!< Number of active sources as of the last pull
+
+        Snapshot() : sources(), active(0) { }
+    };
+
+    //! Scheduled source event.
+    struct Event
+    {
+        enum class Type : uint8_t
+        {
+            START   = 0x0,  //!< Start rendering the source.
+            STOP    = 0x1,  //!< Stop rendering the source.
+            GAIN    = 0x2   //!< Change the volume of the source.
+        };
+
+        uint64_t        frame;  //!< Track clock frame to apply the event at
+        Type            type;   //!< Event type
+        AsourcePointer  source; //!< Source to apply the event onto
+        Afloat          gainL;  //!< New left channel volume
+        Afloat          gainR;  //!< New right channel volume
+    };
+
+    using AeventList = std::vector< Event >;
 
 private:
     mutable std::mutex  mPmutex;    //!< Track pool mutex
     mutable std::mutex  mOmutex;    //!< Track output mutex
+    mutable std::mutex  mCmutex;    //!< Track source list mutex
 
     std::string         mName;      //!< Track label (for identifying tracks)
+    Achan               mChannels;  //!< Number of interleaved channels
     ArenderConfig       mPconfig;   //!< Track render configuration
 
-    AsourceSet     mPsources;  //!< Sound sources to mix from
+    AsourceSet     mPsources;  //!< Sound sources to mix from, guarded by the source list mutex
+
+    std::atomic<const Snapshot*>    mPsnapshot; //!< Published source list
+    mutable std::atomic<size_t>     mPreaders;  //!< Number of threads reading a snapshot
+    std::vector<const Snapshot*>    mPretired;  //!< Replaced snapshots awaiting deletion
+    const Snapshot                * mPcurrent;  //!< Snapshot being pulled
+
+    AthreadPoolPtr          mPpool;     //!< Worker pool for parallel pulls
+    size_t                  mPgrain;    //!< Minimum number of sources per task
+    std::vector<AfBuffer>   mPscratch;  //!< Per-task mixing buffers
+    std::vector<PullTask>   mPtasks;    //!< Per-task parameters
     AfBuffer    mPbuffer;   //!< Mixing buffer
     AfBuffer    mObuffer;   //!< Output buffer
-    AscRack     mOfilter;   //!< Post-mixing filter rack
+    size_t      mPdirty;    //!< Number of frames written into the mixing buffer
+    size_t      mOdirty;    //!< Number of frames written into the output buffer
+    size_t      mOframes;   //!< Number of frames in the output block
+    ArackPointer mOfilter;  //!< Post-mixing filter rack, of \ref mChannels channels
+
+    uint64_t    mPclock;    //!< Track clock frame of the next block to pull
+    AeventList  mPevents;   //!< Scheduled events, latest first
+    AeventList  mPdue;      //!< Events inside the block being pulled, earliest first
+    AsourceList mPheld;     //!< Attached sources that are stopped
+    AsourceList mPsplit;    //!< Sources with events inside the block being pulled
+
+    std::atomic<size_t> mPpending;  //!< Number of scheduled events and stopped sources
+
+    std::atomic<bool>   mqActive;   //!< Is this source active?
 
-    bool        mqActive;   //!< Is this source active?
+    std::atomic<bool>   mOprepared; //!< Has the output been prepared ahead of \ref render() for this cycle?
+
+    //! Source list revision counter shared by all tracks.
+    static std::atomic<unsigned long> sTopologyEpoch;
 
 private:
     //!\name Non-thread-safe methods
     //!\{
 
     //! Pull source into pool buffer, without mutex lock.
-    void fpull(AsourcePointer src);
+    //! \return true if the source was rendered and is still active.
+    bool fpull(const AsourcePointer &src, const ArenderConfig &config);
+
+    //! Renders a source over part of the pool buffer, without mutex lock.
+    void fpull(const AsourcePointer &src, const ArenderConfig &config, uint64_t begin, uint64_t end);
+
+    //! \return true if a source is not rendered over the whole block.
+    bool fskip(const AsourcePointer &src) const;
+
+    //! Moves the events inside the next block into the due list.
+    void fcollect(const ArenderConfig &config);
+
+    //! Renders the sources with events over their running ranges.
+    //! \return number of active sources among the ones skipped by the main pull.
+    size_t fevents(const ArenderConfig &config);
+
+    //! Queues an event, without mutex lock.
+    void fschedule(const Event &event);
+
+    //! Updates the pending event count, without mutex lock.
+    void fpending();
+
+    /*! Pull assigned sources into pool buffer, without mutex lock.
+     *  \param config block to pull; this is \ref mPconfig, or a copy of
+     *                it with fewer frames for a short block.
+     */
+    void fpull(const ArenderConfig &config);
+
+    //! Pull assigned sources into pool buffer in parallel, without mutex lock.
+    //! \param[out] active number of rendered sources still active.
+    //! \return false if there are too few sources to split the work.
+    bool fpull_parallel(const ArenderConfig &config, size_t &active);
 
-    //! Pull assigned sources into pool buffer, without mutex lock.
-    void fpull();
+    //! Marks the first `frames` frames of the pool buffer as written.
+    inline void fdirty(size_t frames) { mPdirty = std::max(mPdirty, frames); }
+
+    //! Renders a range of sources into a scratch buffer.
+    static void pull_task(void* task);
+
+    //! Sums a scratch buffer into another one.
+    static void reduce_task(void* task);
 
     //! Flip pool buffer with output buffer, without mutex lock.
-    void fflip();
+    //! \param config block that was pulled into the pool buffer.
+    void fflip(const ArenderConfig &config);
 
     //! Apply filter rack onto output buffer, without mutex lock.
     void ffilter();
 
     //!\}
 
+    //!\name Source list snapshots
+    //!\{
+
+    //! Starts reading the published snapshot; see \ref frelease().
+    const Snapshot* facquire() const;
+
+    //! Stops reading a snapshot obtained from \ref facquire().
+    void frelease() const;
+
+    /*! Publishes a new source list, with source list mutex lock.
+     *  \param sources  new source list.
+     *  \param attached source added to the list, if any.
+     */
+    void fpublish(AsourceList sources, const AsourcePointer &attached);
+
+    //! Deletes replaced snapshots nobody reads, with source list mutex lock.
+    void freclaim();
+
+    //!\}
+
 public:
-    Track(size_t sample_rate, size_t frames, std::string name = "Unnamed Track");
+    /*! Track constructor.
+     *  \param sample_rate sampling rate of the track.
+     *  \param frames      number of frames to mix per pull.
+     *  \param name        track label.
+     *  \param workers     number of worker threads to pull sources with.
+     *                     If 0, sources are pulled on the calling thread.
+     *  \param grain       minimum number of sources per parallel task.
+     *  \param channels    number of interleaved channels to mix, from 1
+     *                     to \ref MAX_CHANNELS.
+     */
+    Track(
+        size_t sample_rate,
+        size_t frames,
+        std::string name = "Unnamed Track",
+        size_t workers = 0,
+        size_t grain   = 32,
+        Achan  channels = 2
+    );
+
+    Track(const Track&) = delete;
+    Track& operator=(const Track&) = delete;
+
+    virtual ~Track();
 
     /*! This call does nothing on a track object.
      *  \warning This call does not drop any of the source and filter
@@ -82,8 +277,8 @@ public:
      */
     virtual void make_active(void*) override
     {
-        MutexLockGuard p_lock(mPmutex);
-        mqActive = !mPsources.empty();
+        MutexLockGuard c_lock(mCmutex);
+        mqActive.store(!mPsources.empty());
     }
 
     /*! Queries whether or not this track is up and running.
@@ -91,28 +286,150 @@ public:
      */
     virtual bool is_active() const override
     {
-        MutexLockGuard p_lock(mPmutex);
-        return mqActive;
+        return mqActive.load();
     }
 
+    /*! Mixes this track into a target buffer.
+     *
+     *  The sources are pulled and flipped first unless the output has
+     *  already been prepared for this cycle through \ref prepare(), in
+     *  which case the frames of the prepared block at the same offset as
+     *  `targetConfig.frameOffset` are mixed in as they are. A prepared
+     *  block can be mixed any number of times, over any part of the
+     *  block, until \ref discard_prepared() is called.
+     */
     virtual void render(AfBuffer &targetBuffer, const ArenderConfig &targetConfig) override;
 
+    /*! Pulls, flips and filters the next block ahead of time so that the
+     *  next call to \ref render() only has to mix the output into the
+     *  parent track. This is used by \ref awe::ArenderGraph to render
+     *  sibling tracks in parallel.
+     */
+    inline void prepare()
+    {
+        pull();
+        flip();
+        mOprepared.store(true, std::memory_order_release);
+    }
+
+    /*! Ends the cycle of a block made by \ref prepare(), so that the next
+     *  call to \ref render() pulls the sources again.
+     */
+    inline void discard_prepared()
+    {
+        mOprepared.store(false, std::memory_order_release);
+    }
+
+    /*! Retrieves the revision counter of the source lists of all tracks.
+     *  The counter changes whenever a source is attached to or detached
+     *  from any track.
+     */
+    static inline unsigned long topology_epoch() { return sTopologyEpoch.load(std::memory_order_acquire); }
+
+    /*! Renders a block of audio straight into an interleaved output
+     *  buffer, without waiting on the track mutexes.
+     *
+     *  This is the entry point for pull-mode rendering from the audio
+     *  device callback. The block is mixed, flipped and filtered as with
+     *  \ref pull() and \ref flip(), and the result overwrites `target`.
+     *
+     *  \param[out] target output buffer of at least `channels * frames`
+     *                     samples, where `channels` is the channel count
+     *                     of this track.
+     *  \param[in]  frames number of frames to render. This must not be
+     *                     larger than the frame count this track was
+     *                     constructed with.
+     *  \return false if another thread is holding one of the track
+     *          mutexes or if `frames` is too large, in which case nothing
+     *          is written into `target`.
+     */
+    bool try_render(Afloat* target, size_t frames);
+
+    //!\name Sample-accurate event scheduling
+    //!\{
+
+    /*! Retrieves the track clock.
+     *  \return track clock frame of the next block to be pulled.
+     */
+    inline uint64_t getClock() const
+    {
+        MutexLockGuard p_lock(mPmutex);
+        return mPclock;
+    }
+
+    /*! Starts a source at a frame on the track clock.
+     *
+     *  The source is attached right away if it is not already, but is not
+     *  rendered before `frame`. Events in the past take effect at the
+     *  start of the next block.
+     *
+     *  \param src   source to start.
+     *  \param frame track clock frame to start the source at.
+     */
+    void schedule_start(AsourcePointer src, uint64_t frame);
+
+    /*! Stops an attached source at a frame on the track clock.
+     *  The source stays attached, but is not rendered from `frame` on
+     *  until it is started again or detached.
+     */
+    void schedule_stop(AsourcePointer src, uint64_t frame);
+
+    /*! Changes the channel volumes of a source at a frame on the track
+     *  clock through \ref Asource::set_gain().
+     */
+    void schedule_gain(AsourcePointer src, uint64_t frame, Afloat left, Afloat right);
+
+    //! Discards all scheduled events.
+    inline void clear_events()
+    {
+        MutexLockGuard p_lock(mPmutex);
+        mPevents.clear();
+        fpending();
+    }
+
+    //!\}
+
     /*! Retrieves the source pool renderer configuration structure of
      *  this track.
-     *  \return a read-only reference to the current configuration structure.
+     *  \return a copy of the current configuration structure.
      */
-    inline const ArenderConfig& getConfig() const { return mPconfig; }
+    inline ArenderConfig getConfig() const
+    {
+        MutexLockGuard p_lock(mPmutex);
+        return mPconfig;
+    }
 
     /*! Sets the source pool renderer configuration structure of this
      *  track.
-     *  \param new_config the new configuration to use in this track.
+     *  \param new_config the new configuration to use in this track. Its
+     *                    channel count is ignored; the channel count of a
+     *                    track cannot be changed.
      */
     inline void setConfig(const ArenderConfig &new_config)
     {
+        MutexLockGuard c_lock(mCmutex);
         MutexLockGuard p_lock(mPmutex);
         mPconfig = new_config;
+        mPconfig.channels = mChannels;
+
+        for(const AsourcePointer &src : mPsources)
+            src->configure(mPconfig);
     }
 
+    /*! Sets the worker pool used to pull sources in parallel.
+     *
+     *  A pool can be shared between tracks. Parallel pulling only kicks
+     *  in when there are at least twice as many sources as `grain`.
+     *
+     *  \param pool  worker pool to use, or `nullptr` to pull sources on
+     *               the calling thread.
+     *  \param grain minimum number of sources per parallel task.
+     */
+    void setThreadPool(AthreadPoolPtr pool, size_t grain = 32);
+
+    //! \return the worker pool used to pull sources in parallel, if any.
+    inline AthreadPoolPtr getThreadPool() const { return mPpool; }
+
     /*! Retrieves the output mutex object which controls the output
      *  buffer and the rack.
      *  \return a reference to the output mutex of this track.
@@ -125,11 +442,28 @@ public:
      */
     inline std::string const & getName() { return mName; }
 
+    //! \return number of interleaved channels mixed by this track.
+    inline Achan getChannelCount() const { return mChannels; }
+
     /*! Retrieves the source list that this track buffers data from.
+     *  \warning Ownership of this object is defined by the source list
+     *           mutex; only use this from the thread that attaches and
+     *           detaches sources.
      *  \return a read-only reference to the source list of this track.
      */
     inline const AsourceSet& getSources() const { return mPsources; }
 
+    /*! Copies the source list that this track buffers data from.
+     *  \return a copy of the source list of this track, without waiting.
+     */
+    inline AsourceList copy_sources() const
+    {
+        const Snapshot* snapshot = facquire();
+        AsourceList sources = snapshot->sources;
+        frelease();
+        return sources;
+    }
+
     /*! Retrieves the track output buffer.
      *  \warning Ownership of this object is defined by the output
      *           mutex obtainable through the \ref getMutex() call.
@@ -137,72 +471,99 @@ public:
      */
     inline const AfBuffer  & getOutput () const { return mObuffer; }
 
+    //! Read-only view of the last block flipped into the output buffer.
+    struct View
+    {
+        const Afloat  * data;       //!< Interleaved frames
+        size_t          frames;     //!< Number of frames in the block
+        Achan           channels;   //!< Number of channels in each frame
+        bool            silent;     //!< Every sample in the block is zero
+    };
+
+    /*! Retrieves the last block flipped into the output buffer, without
+     *  copying it.
+     *  \warning The view is only valid while holding the output mutex
+     *           obtainable through the \ref getMutex() call.
+     */
+    inline View getView() const { return { mObuffer.data(), mOframes, mChannels, mOdirty == 0 }; }
+
     /*! Retrieves the track filter rack.
      *  \warning Ownership of this object is defined by the output
      *           mutex obtainable through the \ref getMutex() call.
+     *  \tparam Channels channel count of this track.
+     *  \throw std::runtime_error if `Channels` is not the channel count
+     *         of this track.
      *  \return a reference to the filter rack of this track.
      */
-    inline AscRack& getRack() { return mOfilter; }
+    template< Achan Channels >
+    inline Filter::Rack<Channels>& getRack()
+    {
+        if (Channels != mChannels)
+            throw std::runtime_error("libawe [exception] Track::getRack: channel count does not match the track.");
+
+        return static_cast< Filter::Rack<Channels>& >(*mOfilter);
+    }
+
+    //! Retrieves the filter rack of a stereo track; see \ref getRack().
+    inline AscRack& getRack() { return getRack<2>(); }
 
     /*! Counts the number of active sources within the source pool.
+     *
+     *  The count is taken by every pull and by every change to the source
+     *  list, so this neither waits on the render path nor queries the
+     *  sources.
+     *
      *  \return number of active sources within the pooling list
      */
     inline size_t count_active_sources() const
     {
-        MutexLockGuard p_lock(mPmutex);
-        size_t count = 0;
-        for(AsourcePointer src : mPsources)
-        {
-            if (src->is_active() == true)
-                count++;
-        }
+        const Snapshot* snapshot = facquire();
+        size_t const count = snapshot->active.load(std::memory_order_acquire);
+        frelease();
         return count;
     }
 
     /*! Counts the number of sources assigned to the source pool.
      *  \return number of sources within the pooling list
      */
-    inline size_t count_sources() const {
-        MutexLockGuard p_lock(mPmutex);
-        return mPsources.size();
+    inline size_t count_sources() const
+    {
+        const Snapshot* snapshot = facquire();
+        size_t const count = snapshot->sources.size();
+        frelease();
+        return count;
     }
 
     /*! Inserts a source into the pooling list.
+     *  This does not wait on the render path.
      *  \param[in] src pointer to the source object to be inserted.
      */
-    inline void attach_source(AsourcePointer src)
-    {
-        MutexLockGuard p_lock(mPmutex);
-        if (mPsources.count(src) == 0)
-            mPsources.insert(src);
-
-        mqActive = true;
-    }
+    void attach_source(AsourcePointer src);
 
     /*! Removes a source from the pooling list.
+     *
+     *  This only waits on the render path if the source is stopped or
+     *  has scheduled events. The track releases its reference to the
+     *  source on a later change to the source list, or when the track is
+     *  destroyed.
+     *
      *  \return false if the no objects were deleted from the pooling
      *          list.
      */
-    inline bool detach_source(AsourcePointer src)
-    {
-        MutexLockGuard p_lock(mPmutex);
-        bool r = mPsources.erase(src) != 0;
-        mqActive = !mPsources.empty();
-        return r;
-    }
+    bool detach_source(AsourcePointer src);
 
     //! Pull assigned sources into pool buffer, with mutex lock.
     inline void pull()
     {
         MutexLockGuard p_lock(mPmutex);
-        fpull();
+        fpull(mPconfig);
     }
 
     //! Pulls the sources pool buffer, with mutex lock.
     inline void pull(AsourcePointer src)
     {
         MutexLockGuard p_lock(mPmutex);
-        fpull(src);
+        fpull(src, mPconfig);
     }
 
     //! Flip pool buffer with output buffer, with mutex lock.
@@ -215,7 +576,7 @@ public:
         {
             // Unlock pool mutex after flipping.
             MutexLockGuard p_lock(mPmutex, std::adopt_lock);
-            fflip();
+            fflip(mPconfig);
         }
 
         ffilter();
@@ -232,6 +593,16 @@ public:
             queue.push(s);
     }
 
+    /*! Pushes the output buffer into a ring buffer in one block.
+     *  \param[out] ring ring buffer to write the output buffer to
+     *  \return number of samples written into the ring buffer.
+     */
+    inline size_t push(AfRingBuffer &ring) const
+    {
+        MutexLockGuard o_lock(mOmutex);
+        return ring.write(mObuffer.data(), mObuffer.size());
+    }
+
 };
 
 
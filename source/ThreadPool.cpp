@@ -0,0 +1,228 @@
+//  ThreadPool.cpp :: Work-stealing worker thread pool
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#include "ThreadPool.hpp"
+
+namespace awe {
+
+//! Index of the queue owned by the current thread, or -1 if not a worker.
+static thread_local long tWorkerIndex = -1;
+
+//! Pool owning the current worker thread.
+static thread_local const AThreadPool* tWorkerPool = nullptr;
+
+/* Queue */
+
+bool AThreadPool::Queue::push(const Task &task)
+{
+    while (lock.test_and_set(std::memory_order_acquire));
+
+    bool const ok = size < Capacity;
+    if (ok) {
+        tasks[(head + size) % Capacity] = task;
+        size += 1;
+    }
+
+    lock.clear(std::memory_order_release);
+    return ok;
+}
+
+bool AThreadPool::Queue::pop(Task &task)
+{
+    while (lock.test_and_set(std::memory_order_acquire));
+
+    bool const ok = size > 0;
+    if (ok) {
+        size -= 1;
+        task = tasks[(head + size) % Capacity];
+    }
+
+    lock.clear(std::memory_order_release);
+    return ok;
+}
+
+bool AThreadPool::Queue::steal(Task &task)
+{
+    while (lock.test_and_set(std::memory_order_acquire));
+
+    bool const ok = size > 0;
+    if (ok) {
+        task = tasks[head];
+        head  = (head + 1) % Capacity;
+        size -= 1;
+    }
+
+    lock.clear(std::memory_order_release);
+    return ok;
+}
+
+bool AThreadPool::Queue::take(Task &task, const ATaskGroup* group)
+{
+    while (lock.test_and_set(std::memory_order_acquire));
+
+    bool ok = false;
+    for(size_t i = size; i > 0 && ok == false; i--) {
+        if (tasks[(head + i - 1) % Capacity].group != group)
+            continue;
+
+        task = tasks[(head + i - 1) % Capacity];
+
+        // Close the gap by moving the newer tasks down one slot.
+        for(size_t j = i; j < size; j++)
+            tasks[(head + j - 1) % Capacity] = tasks[(head + j) % Capacity];
+
+        size -= 1;
+        ok = true;
+    }
+
+    lock.clear(std::memory_order_release);
+    return ok;
+}
+
+/* Pool */
+
+AThreadPool::AThreadPool(size_t workers)
+    : mQueues   ()
+    , mWorkers  ()
+    , mQueued   (0)
+    , mNext     (0)
+    , mSleeping (0)
+    , mStop     (false)
+{
+    for(size_t i = 0; i < workers; i++)
+        mQueues.emplace_back(new Queue());
+
+    for(size_t i = 0; i < workers; i++)
+        mWorkers.emplace_back(&AThreadPool::work, this, i);
+}
+
+AThreadPool::~AThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStop.store(true);
+    }
+    mSleepCond.notify_all();
+
+    for(std::thread &worker : mWorkers)
+        worker.join();
+}
+
+void AThreadPool::run(const Task &task)
+{
+    task.func(task.data);
+    task.group->mPending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool AThreadPool::take(size_t index, Task &task)
+{
+    if (mQueues.empty() || mQueued.load(std::memory_order_acquire) == 0)
+        return false;
+
+    if (index < mQueues.size() && mQueues[index]->pop(task)) {
+        mQueued.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    // Steal from the other queues, starting with the next one along.
+    for(size_t i = 1; i <= mQueues.size(); i++) {
+        if (mQueues[(index + i) % mQueues.size()]->steal(task)) {
+            mQueued.fetch_sub(1, std::memory_order_acq_rel);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool AThreadPool::take(size_t index, Task &task, const ATaskGroup &group)
+{
+    if (mQueues.empty() || mQueued.load(std::memory_order_acquire) == 0)
+        return false;
+
+    for(size_t i = 0; i < mQueues.size(); i++) {
+        if (mQueues[(index + i) % mQueues.size()]->take(task, &group)) {
+            mQueued.fetch_sub(1, std::memory_order_acq_rel);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void AThreadPool::work(size_t index)
+{
+    tWorkerIndex = static_cast<long>(index);
+    tWorkerPool  = this;
+
+    Task task;
+
+    while (true)
+    {
+        if (take(index, task)) {
+            run(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+
+        if (mStop.load() && mQueued.load() == 0)
+            return;
+
+        mSleeping.fetch_add(1);
+        mSleepCond.wait(lock, [this] { return mStop.load() || mQueued.load() != 0; });
+        mSleeping.fetch_sub(1);
+    }
+}
+
+void AThreadPool::submit(ATaskGroup &group, TaskFunc func, void* data)
+{
+    Task const task = { func, data, &group };
+
+    group.mPending.fetch_add(1, std::memory_order_acq_rel);
+
+    if (mQueues.empty()) {
+        run(task);
+        return;
+    }
+
+    size_t const index = (tWorkerPool == this)
+        ? static_cast<size_t>(tWorkerIndex)
+        : mNext.fetch_add(1, std::memory_order_relaxed) % mQueues.size();
+
+    // Count the task before it becomes visible so the counter never
+    // goes below the number of tasks actually queued.
+    mQueued.fetch_add(1);
+
+    if (mQueues[index]->push(task) == false) {
+        mQueued.fetch_sub(1);
+        run(task);
+        return;
+    }
+
+    if (mSleeping.load() != 0) {
+        // Take the lock so that the wake-up cannot slip in between a
+        // worker checking the queue and going to sleep.
+        { std::lock_guard<std::mutex> lock(mSleepMutex); }
+        mSleepCond.notify_one();
+    }
+}
+
+void AThreadPool::wait(ATaskGroup &group)
+{
+    size_t const index = (tWorkerPool == this) ? static_cast<size_t>(tWorkerIndex) : 0;
+
+    Task task;
+
+    // Only run tasks of this group; anything else might be slow work
+    // (such as sample loading) that the caller cannot afford to wait on.
+    while (group.done() == false)
+    {
+        if (take(index, task, group))
+            run(task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+}
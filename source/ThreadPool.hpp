@@ -0,0 +1,145 @@
+//  ThreadPool.hpp :: Work-stealing worker thread pool
+//  Copyright 2014 Chu Chin Kuan <keigen.shu@gmail.com>
+
+#ifndef AWE_THREADPOOL_H
+#define AWE_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Define.hpp"
+
+namespace awe {
+
+/*! Group of tasks that can be waited on together.
+ *
+ *  A task group counts the number of tasks submitted under it that have
+ *  not finished yet. It must outlive all of its tasks.
+ */
+class ATaskGroup
+{
+    friend class AThreadPool;
+
+private:
+    std::atomic<size_t> mPending;   //!< Number of unfinished tasks
+
+public:
+    ATaskGroup() : mPending(0) { }
+
+    ATaskGroup(const ATaskGroup&) = delete;
+    ATaskGroup& operator=(const ATaskGroup&) = delete;
+
+    //! \return true if all tasks in this group have finished.
+    inline bool done() const { return mPending.load(std::memory_order_acquire) == 0; }
+};
+
+/*! Fixed-size worker thread pool with per-worker work-stealing queues.
+ *
+ *  Every worker owns a bounded task queue. Tasks submitted from a worker
+ *  go into its own queue and tasks submitted from other threads are
+ *  spread across the workers round-robin. An idle worker takes tasks
+ *  from the back of its own queue first, then steals from the front of
+ *  other workers' queues, and only goes to sleep when all queues are
+ *  empty.
+ *
+ *  Tasks are plain function pointers with a user data pointer, so
+ *  submitting one does not allocate. Threads that wait on a task group
+ *  help run queued tasks of that group instead of blocking, which makes
+ *  it safe to wait from inside a task. Tasks of other groups are never
+ *  run by a waiting thread, so a render thread sharing the pool with
+ *  slow background work only ever runs its own tasks.
+ */
+class AThreadPool
+{
+public:
+    using TaskFunc = void (*)(void* userData);
+
+private:
+    //! Queued task.
+    struct Task
+    {
+        TaskFunc    func;   //!< Function to run
+        void      * data;   //!< User data passed to function
+        ATaskGroup* group;  //!< Group to notify when done
+    };
+
+    //! Bounded double-ended task queue of a single worker.
+    struct Queue
+    {
+        static constexpr size_t Capacity = 256;
+
+        std::atomic_flag    lock;               //!< Spin lock
+        Task                tasks[Capacity];    //!< Task ring
+        size_t              head;               //!< Index of oldest task
+        size_t              size;               //!< Number of queued tasks
+
+        Queue() : head(0), size(0) { lock.clear(); }
+
+        bool push(const Task &task);    //!< Pushes to the back.
+        bool pop (Task &task);          //!< Pops from the back (owner).
+        bool steal(Task &task);         //!< Pops from the front (thieves).
+
+        //! Removes the newest task belonging to `group`.
+        bool take (Task &task, const ATaskGroup* group);
+    };
+
+    std::vector< std::unique_ptr<Queue> >   mQueues;    //!< One queue per worker
+    std::vector< std::thread >              mWorkers;   //!< Worker threads
+
+    std::atomic<size_t>     mQueued;    //!< Number of queued tasks across all queues
+    std::atomic<size_t>     mNext;      //!< Round-robin queue index for external submits
+    std::atomic<size_t>     mSleeping;  //!< Number of sleeping workers
+    std::atomic<bool>       mStop;      //!< Shut down flag
+
+    std::mutex              mSleepMutex;
+    std::condition_variable mSleepCond;
+
+    //! Worker thread main loop.
+    void work(size_t index);
+
+    //! Takes a task from queue `index` or steals one from another queue.
+    bool take(size_t index, Task &task);
+
+    //! Takes a task of `group` from queue `index` or from another queue.
+    bool take(size_t index, Task &task, const ATaskGroup &group);
+
+    //! Runs a task and notifies its group.
+    static void run(const Task &task);
+
+public:
+    /*! Starts the worker threads.
+     *  \param workers number of worker threads to start. If 0, tasks are
+     *                 run by the threads that wait on them.
+     */
+    AThreadPool(size_t workers = std::thread::hardware_concurrency());
+
+    //! Stops the worker threads after they finish their queued tasks.
+    ~AThreadPool();
+
+    AThreadPool(const AThreadPool&) = delete;
+    AThreadPool& operator=(const AThreadPool&) = delete;
+
+    //! \return number of worker threads in this pool.
+    inline size_t size() const { return mWorkers.size(); }
+
+    /*! Queues a task for execution.
+     *  If the target queue is full, the task is run immediately on the
+     *  calling thread.
+     *  \param group task group to count this task under.
+     *  \param func  task function.
+     *  \param data  user data passed to the task function.
+     */
+    void submit(ATaskGroup &group, TaskFunc func, void* data);
+
+    /*! Waits for all tasks in a group to finish, running queued tasks of
+     *  the same group on the calling thread in the meantime.
+     */
+    void wait(ATaskGroup &group);
+};
+
+}
+
+#endif
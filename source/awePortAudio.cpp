@@ -3,6 +3,7 @@
 
 #include "awePortAudio.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 
@@ -28,30 +29,41 @@ static int PaCallback(
     if (statusFlags == paOutputUnderflow)
         data->underflows++;
 
-    /* Library failed to update sooner. */
-    if (data->output->size() < framesPerBuffer * 2) {
-        for (unsigned int i = 0; i < framesPerBuffer; i++) {
-            *out++ = 0;
-            *out++ = 0;
-        }
-    } else {
-        data->mutex->lock();
-        for (unsigned int i = 0; i < framesPerBuffer; i++) {
-            *out++ = data->output->front(); data->output->pop();
-            *out++ = data->output->front(); data->output->pop();
-        }
-        data->mutex->unlock();
+    /* Pull mode; render straight into the device buffer. */
+    if (data->render != nullptr) {
+        data->render(out, framesPerBuffer, data->renderData);
+        data->calls++;
+        return 0;
     }
 
+    /* Library failed to update sooner; pad the rest with silence. */
+    size_t const want = framesPerBuffer * 2;
+    size_t const done = data->output->read(out, want);
+    std::fill(out + done, out + want, 0.0f);
+
     data->calls++;
     return 0;
 }
 
 
+APortAudio::APortAudio()
+    : mPAerror   (paNoError)
+    , mPAostream (nullptr)
+    , mSampleRate(0)
+    , mFrameRate (0)
+{
+    mPApacket.render     = nullptr;
+    mPApacket.renderData = nullptr;
+    mPApacket.output     = &mOutputQueue;
+    mPApacket.calls      = 0;
+    mPApacket.underflows = 0;
+}
+
 bool APortAudio::init(
         unsigned int sample_rate,
         unsigned int frame_count,
-        HostAPIType device_type
+        HostAPIType device_type,
+        unsigned int queue_blocks
         )
 {
     mSampleRate = sample_rate;
@@ -81,14 +93,19 @@ bool APortAudio::init(
         return false;
     }
 
-    mPApacket.mutex       = &mOutputMutex;
+    /* The output queue is not used in pull mode. */
+    if (mPApacket.render == nullptr)
+        mOutputQueue.reset(2 * frame_count * std::max(queue_blocks, 2u));
+
     mPApacket.output      = &mOutputQueue;
     mPApacket.calls       = 0;
     mPApacket.underflows  = 0;
 
     mPAostream_params.channelCount = 2;  /* Stereo output. */
     mPAostream_params.sampleFormat = paFloat32;
-    mPAostream_params.suggestedLatency = Pa_GetDeviceInfo(mPAostream_params.device)->defaultHighOutputLatency;
+    mPAostream_params.suggestedLatency = (mPApacket.render == nullptr)
+        ? Pa_GetDeviceInfo(mPAostream_params.device)->defaultHighOutputLatency
+        : Pa_GetDeviceInfo(mPAostream_params.device)->defaultLowOutputLatency;
     mPAostream_params.hostApiSpecificStreamInfo = NULL;
     mPAerror = Pa_OpenStream(
             &mPAostream, NULL,          /* One output stream, No input. */
@@ -118,22 +135,17 @@ bool APortAudio::test_error() const
 
 unsigned short int APortAudio::fplay(AfBuffer const& buffer)
 {
-    mOutputMutex.lock();
-
-    for(Afloat const & smp : buffer)
-        mOutputQueue.push(smp);
+    mOutputQueue.write(buffer.data(), buffer.size());
 
-    if (mPApacket.underflows != 0)
-        fprintf( stdout, "PortAudio [warn] %u device underflows(s) on last update.\n", mPApacket.underflows );
-    if (mPApacket.calls > 1)
-        fprintf( stdout, "PortAudio [warn] %u libawe underflows(s) on last update.\n", mPApacket.calls - 1 );
+    unsigned char const underflows = mPApacket.underflows.exchange(0);
+    unsigned char const calls      = mPApacket.calls     .exchange(0);
 
-    mPApacket.calls = 0;
-    mPApacket.underflows = 0;
-
-    mOutputMutex.unlock();
+    if (underflows != 0)
+        fprintf( stdout, "PortAudio [warn] %u device underflows(s) on last update.\n", underflows );
+    if (calls > 1)
+        fprintf( stdout, "PortAudio [warn] %u libawe underflows(s) on last update.\n", calls - 1 );
 
-    return 0;
+    return underflows;
 }
 
 void APortAudio::shutdown()
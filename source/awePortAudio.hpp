@@ -5,8 +5,9 @@
 #define AWE_PORTAUDIO_H
 
 #include <portaudio.h>
-#include <mutex>
+#include <atomic>
 #include "Define.hpp"
+#include "RingBuffer.hpp"
 
 namespace awe {
 
@@ -15,13 +16,23 @@ namespace awe {
 class APortAudio
 {
 public:
+    /*! Pull-mode render function type.
+     *  Called from the PortAudio callback to write exactly `frames` frames
+     *  of interleaved stereo audio into `output`. It must be real-time
+     *  safe; see \ref awe::Asource::render().
+     */
+    using RenderFunc = void (*)(Afloat* output, unsigned long frames, void* userData);
+
     //! PortAudio callback data structure.
     struct PaCallbackPacket
     {
-        std::mutex  *   mutex;      //<! Output FIFO buffer mutex.
-        AfFIFOBuffer*   output;     //<! Output FIFO buffer pointer.
-        unsigned char   calls;      //<! Number of times PA ran this callback since last update.
-        unsigned char   underflows; //<! Number of times PA reported underflow problems since last update.
+        RenderFunc      render;     //<! Pull-mode render function; null to play from the output ring buffer.
+        void        *   renderData; //<! User data passed to the render function.
+        AfRingBuffer*   output;     //<! Output ring buffer pointer.
+        std::atomic<unsigned char>
+                        calls;      //<! Number of times PA ran this callback since last update.
+        std::atomic<unsigned char>
+                        underflows; //<! Number of times PA reported underflow problems since last update.
     };
 
     //! PortAudio audio output host API enumerator
@@ -48,8 +59,7 @@ private:
     PaStreamParameters  mPAostream_params;
     PaCallbackPacket    mPApacket;
 
-    AfFIFOBuffer        mOutputQueue;
-    std::mutex          mOutputMutex;
+    AfRingBuffer        mOutputQueue;
 
     unsigned int    mSampleRate;
     unsigned int    mFrameRate;
@@ -58,22 +68,56 @@ private:
     bool test_error() const;
 
 public:
+    APortAudio();
+
     inline unsigned char pa_calls           () const { return mPApacket.calls; }
     inline double        pa_stream_cpu_load () const { return Pa_GetStreamCpuLoad(mPAostream); }
     inline double        pa_stream_time     () const { return Pa_GetStreamTime   (mPAostream); }
-    inline AfFIFOBuffer& getFIFOBuffer      ()       { return mOutputQueue; }
-    inline std::mutex  & getFIFOBuffer_mutex()       { return mOutputMutex; }
+    inline AfRingBuffer& getRingBuffer      ()       { return mOutputQueue; }
+
+    //!\name Output buffer fill level counters
+    //!\{
+    inline size_t        getBufferFill      () const { return mOutputQueue.size(); }
+    inline size_t        getBufferCapacity  () const { return mOutputQueue.capacity(); }
+    inline size_t        getBufferLowWater  () const { return mOutputQueue.low_water(); }
+    inline size_t        getBufferUnderruns () const { return mOutputQueue.underruns(); }
+    inline size_t        getBufferOverruns  () const { return mOutputQueue.overruns(); }
+    //!\}
 
     inline unsigned int  getSampleRate() const { return mSampleRate; }
     inline unsigned int  getFrameRate () const { return mFrameRate ; }
 
+    /*! Switches the device into pull mode, in which the PortAudio callback
+     *  renders audio through `render` instead of reading it out of the
+     *  output ring buffer.
+     *  \note This must be called before \ref init().
+     *  \param render   render function; null to switch back to push mode.
+     *  \param userData user data passed to the render function.
+     */
+    inline void setRenderer(RenderFunc render, void* userData)
+    {
+        mPApacket.render     = render;
+        mPApacket.renderData = userData;
+    }
+
+    //! \return true if the device is rendering in pull mode.
+    inline bool isPullMode() const { return mPApacket.render != nullptr; }
+
     //! Plays provided buffer. @returns underruns since last play.
     unsigned short int fplay(const AfBuffer& buffer);
 
+    /*! Opens and starts the output stream.
+     *  \param sample_rate   output sampling rate.
+     *  \param frame_count   number of frames PortAudio requests per callback.
+     *  \param device_type   PortAudio output device type to use.
+     *  \param queue_blocks  number of `frame_count` sized blocks the output
+     *                       ring buffer can hold.
+     */
     bool init(
             unsigned int sample_rate,
             unsigned int frame_count,
-            HostAPIType device_type = HostAPIType::Default
+            HostAPIType device_type = HostAPIType::Default,
+            unsigned int queue_blocks = 4
             );
     void shutdown();
 };
@@ -1,7 +1,10 @@
 //  awesndfile.cpp :: Audio file reader via libsndfile
 //  Copyright 2012 - 2014 Chu Chin Kuan <keigen.shu@gmail.com>
 
-#include <exception>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include "awesndfile.hpp"
 #include "Sample.hpp"
 
@@ -10,10 +13,24 @@ namespace awe
 {
 
 /* read data from SNDFILE into sample */
-void read_sndfile(Asample* sample, SNDFILE* sndf, SF_INFO* info)
+void read_sndfile(Asample* sample, SNDFILE* sndf, SF_INFO* info, Asample::Format format)
 {
     const size_t samples = info->channels * info->frames;
 
+    if (format == Asample::Format::FLOAT32) {
+        // Keep the decoded data as is; no peak compensation is needed.
+        std::shared_ptr<AfBuffer> buff = std::make_shared<AfBuffer>(samples, 0.f);
+        sf_readf_float(sndf, buff->data(), info->frames);
+
+        sample->setSource(buff);
+
+        sf_close(sndf);
+
+        delete info;
+
+        return;
+    }
+
     // Second buffer needed for overclip bug workaround
     AiBuffer* bufi = new AiBuffer();
               bufi->reserve(samples);
@@ -43,6 +60,9 @@ void read_sndfile(Asample* sample, SNDFILE* sndf, SF_INFO* info)
     // Save buffer into sample, clean up and return
     sample->setSource(std::shared_ptr<AiBuffer>(bufi), peakValue);
 
+    if (format == Asample::Format::ADPCM)
+        sample->compress();
+
     sf_close(sndf);
 
     delete info;
@@ -53,6 +73,14 @@ void read_sndfile(Asample* sample, SNDFILE* sndf, SF_INFO* info)
 
 /* Read from memory -- libsndfile virtual IO functions */
 
+SF_VIRTUAL_IO awe_sf_vmio = {
+    awe_sf_vmio_get_filelen,
+    awe_sf_vmio_seek,
+    awe_sf_vmio_read,
+    awe_sf_vmio_write,
+    awe_sf_vmio_tell
+};
+
 sf_count_t awe_sf_vmio_get_filelen(void* user_data)
 {
     awe_sf_vmio_data* io = (awe_sf_vmio_data*) user_data;
@@ -68,30 +96,34 @@ sf_count_t awe_sf_vmio_tell(void* user_data)
 sf_count_t awe_sf_vmio_seek(sf_count_t offset, int whence, void* user_data)
 {
     awe_sf_vmio_data* io = (awe_sf_vmio_data*) user_data;
+    sf_count_t base;
 
     switch (whence)
     {
-        case SEEK_SET: io->curr =        0 + offset; break;
-        case SEEK_CUR: io->curr = io->curr + offset; break;
-        case SEEK_END: io->curr = io->size; break;
-        default: throw std::exception(); break;
+        case SEEK_SET: base =        0; break;
+        case SEEK_CUR: base = io->curr; break;
+        case SEEK_END: base = io->size; break;
+        default: return -1;
     }
 
+    // Do not let libsndfile seek outside of the memory block.
+    if (base + offset < 0 || base + offset > io->size)
+        return -1;
+
+    io->curr = base + offset;
     return io->curr;
 }
 
 sf_count_t awe_sf_vmio_read(void* ptr, sf_count_t count, void* user_data)
 {
     awe_sf_vmio_data* io = (awe_sf_vmio_data*)user_data;
-    sf_count_t realcount = 0;
-    char* sptr = (char*)ptr;
-
-    for (sf_count_t i = 0; i < count; i++) {
-        if (io->curr < io->size) {
-            sptr[i] = io->mptr[io->curr];
-            io->curr++;
-            realcount++;
-        }
+
+    // Clamp the request to the end of the memory block and copy it at once.
+    sf_count_t const realcount = std::max<sf_count_t>(0, std::min(count, io->size - io->curr));
+
+    if (realcount > 0) {
+        memcpy(ptr, io->mptr + io->curr, realcount);
+        io->curr += realcount;
     }
 
     return realcount;
@@ -100,23 +132,27 @@ sf_count_t awe_sf_vmio_read(void* ptr, sf_count_t count, void* user_data)
 sf_count_t awe_sf_vmio_write(const void* ptr, sf_count_t count, void* user_data)
 {
     awe_sf_vmio_data* io = (awe_sf_vmio_data*)user_data;
-    sf_count_t realcount = 0;
-    char* sptr = (char*)ptr;
-
-    for (sf_count_t i = 0; i < count; i++) {
-        if (io->curr < io->size) {
-            io->mptr[io->curr] = sptr[i];
-            io->curr++;
-            realcount++;
-        }
+
+    // The memory block cannot grow; clamp the write to its end.
+    sf_count_t const realcount = std::max<sf_count_t>(0, std::min(count, io->size - io->curr));
+
+    if (realcount > 0) {
+        memcpy(io->mptr + io->curr, ptr, realcount);
+        io->curr += realcount;
     }
 
     return realcount;
 }
 
 // Asample constructors
-Asample::Asample(const std::string& file)
+Asample::Asample(const std::string& file, Format format)
     : mSource(nullptr)
+    , mFloatSource(nullptr)
+    , mCompressed(nullptr)
+    , mStorage(nullptr)
+    , mData(nullptr)
+    , mLength(0)
+    , mFormat(format)
     , mChannels(0)
     , mSourcePeak(1.0)
     , mSampleRate(0)
@@ -131,8 +167,8 @@ Asample::Asample(const std::string& file)
         return;
     }
 
-    if (info->channels > 2) {
-        fprintf(stderr, "libawe [error] %s: libawe currently only supports mono and stereo. \n", file.c_str());
+    if (info->channels > MAX_CHANNELS) {
+        fprintf(stderr, "libawe [error] %s: libawe supports at most %u channels.\n", file.c_str(), unsigned(MAX_CHANNELS));
         sf_close(sndf);
         return;
     }
@@ -140,7 +176,7 @@ Asample::Asample(const std::string& file)
     mChannels   = info->channels;
     mSampleRate = info->samplerate;
 
-    read_sndfile(this, sndf, info);
+    read_sndfile(this, sndf, info, format);
 
     return;
 }
@@ -148,8 +184,15 @@ Asample::Asample(const std::string& file)
 Asample::Asample(
     char              * mptr,
     const size_t      & size,
-    const std::string &_name
+    const std::string &_name,
+    Format             format
 )   : mSource(nullptr)
+    , mFloatSource(nullptr)
+    , mCompressed(nullptr)
+    , mStorage(nullptr)
+    , mData(nullptr)
+    , mLength(0)
+    , mFormat(format)
     , mChannels(0)
     , mSourcePeak(1.0)
     , mSampleRate(0)
@@ -166,8 +209,8 @@ Asample::Asample(
         return;
     }
 
-    if (info->channels > 2) {
-        fprintf(stderr, "libawe [error] %p: libawe currently only supports mono and stereo. \n", mptr);
+    if (info->channels > MAX_CHANNELS) {
+        fprintf(stderr, "libawe [error] %p: libawe supports at most %u channels.\n", mptr, unsigned(MAX_CHANNELS));
         sf_close(sndf);
         return;
     }
@@ -175,9 +218,51 @@ Asample::Asample(
     mChannels   = info->channels;
     mSampleRate = info->samplerate;
 
-    read_sndfile(this, sndf, info);
+    read_sndfile(this, sndf, info, format);
 
     return;
 }
 
+// AsndfileWriter
+AsndfileWriter::AsndfileWriter(
+    const std::string &file,
+    unsigned long      sample_rate,
+    Achan              channels,
+    int                format
+)   : mFile(nullptr)
+    , mInfo()
+    , mName(file)
+{
+    mInfo.samplerate = sample_rate;
+    mInfo.channels   = channels;
+    mInfo.format     = format;
+
+    if (sf_format_check(&mInfo) == SF_FALSE) {
+        fprintf(stderr, "libawe [error] %s: unsupported output format 0x%08x.\n", file.c_str(), format);
+        return;
+    }
+
+    mFile = sf_open(file.c_str(), SFM_WRITE, &mInfo);
+
+    if (sf_error(mFile) != SF_ERR_NO_ERROR) {
+        fprintf(stderr, "libsndfile [error] %s: %s.\n", file.c_str(), sf_strerror(mFile));
+        sf_close(mFile);
+        mFile = nullptr;
+    }
+}
+
+AsndfileWriter::~AsndfileWriter()
+{
+    if (mFile != nullptr)
+        sf_close(mFile);
+}
+
+size_t AsndfileWriter::write(const Afloat* data, size_t frames)
+{
+    if (mFile == nullptr)
+        return 0;
+
+    return sf_writef_float(mFile, data, frames);
+}
+
 }
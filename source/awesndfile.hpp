@@ -5,6 +5,9 @@
 #define AWE_SNDFILE_H
 
 #include <sndfile.h>
+#include <string>
+#include "Define.hpp"
+#include "Sample.hpp"
 
 namespace awe
 {
@@ -25,18 +28,11 @@ sf_count_t awe_sf_vmio_seek(sf_count_t offset, int whence, void* user_data);
 sf_count_t awe_sf_vmio_read(void* ptr, sf_count_t count, void* user_data);
 sf_count_t awe_sf_vmio_write(const void* ptr, sf_count_t count, void* user_data);
 
-SF_VIRTUAL_IO awe_sf_vmio = {
-    awe_sf_vmio_get_filelen,
-    awe_sf_vmio_seek,
-    awe_sf_vmio_read,
-    awe_sf_vmio_write,
-    awe_sf_vmio_tell
-};
+extern SF_VIRTUAL_IO awe_sf_vmio;
 
 //!@}
 #endif
 
-class Asample;
 
 /** Reads audio data from a `libsndfile` instance into a \ref awe::Asample.
  *  Upon exit, the `SNDFILE*` object is closed via `sf_close()` and memory
@@ -47,8 +43,65 @@ class Asample;
  *                  `sf_open_virtual()`.
  *  \param info     Pointer to `SF_INFO` object passed to `sf_open()` or
  *                  `sf_open_virtual()`.
+ *  \param format   Format to store the audio data in.
+ */
+void read_sndfile(Asample* sample, SNDFILE* sndf, SF_INFO* info, Asample::Format format);
+
+/** Audio file writer via `libsndfile`.
+ *
+ *  Writes interleaved \ref awe::Afloat audio buffers into a sound file.
+ *  The file is closed when this object is destroyed.
  */
-void read_sndfile(Asample* sample, SNDFILE* sndf, SF_INFO* info);
+class AsndfileWriter
+{
+private:
+    SNDFILE*    mFile;  //!< libsndfile file handle
+    SF_INFO     mInfo;  //!< libsndfile file format description
+    std::string mName;  //!< Path to output file
+
+public:
+    /** Opens a sound file for writing.
+     *
+     *  \warning This function leaves the writer closed if it fails to
+     *           open the file; check \ref is_open() before writing.
+     *
+     *  \param file        Path to output file.
+     *  \param sample_rate Sampling rate of the audio data.
+     *  \param channels    Number of interleaved channels in the audio data.
+     *  \param format      libsndfile major and minor format flags, e.g.
+     *                     `SF_FORMAT_FLAC | SF_FORMAT_PCM_24`.
+     */
+    AsndfileWriter(
+        const std::string &file,
+        unsigned long      sample_rate,
+        Achan              channels = 2,
+        int                format   = SF_FORMAT_WAV | SF_FORMAT_PCM_16
+    );
+
+    AsndfileWriter(const AsndfileWriter&) = delete;
+    AsndfileWriter& operator=(const AsndfileWriter&) = delete;
+
+    virtual ~AsndfileWriter();
+
+    inline bool          is_open        () const { return mFile != nullptr; }
+    inline Achan         getChannelCount() const { return mInfo.channels; }
+    inline unsigned long getSampleRate  () const { return mInfo.samplerate; }
+    inline std::string   getName        () const { return mName; }
+
+    /** Writes interleaved frames into the file.
+     *  \param data   pointer to interleaved audio data.
+     *  \param frames number of frames to write.
+     *  \return number of frames actually written.
+     */
+    size_t write(const Afloat* data, size_t frames);
+
+    /** Writes a whole interleaved audio buffer into the file.
+     *  \return number of frames actually written.
+     */
+    inline size_t write(const AfBuffer &buffer) {
+        return write(buffer.data(), buffer.size() / getChannelCount());
+    }
+};
 
 }
 
@@ -0,0 +1,107 @@
+#include "../source/Kernels.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace awe;
+
+/* Mixing loop as it was written in Sampler::render before the kernels. */
+static void reference_mix(Afloat* dst, const AiBuffer& src, size_t frames, size_t channels, const Afloat* gain, Afloat peak)
+{
+    for (size_t f = 0; f < frames; f++) {
+        if (channels == 2) {
+            dst[f*2  ] += to_Afloat(src.at(f*2  )) * gain[0] * peak;
+            dst[f*2+1] += to_Afloat(src.at(f*2+1)) * gain[1] * peak;
+        } else {
+            dst[f*2  ] += to_Afloat(src.at(f    )) * gain[0] * peak;
+            dst[f*2+1] += to_Afloat(src.at(f    )) * gain[1] * peak;
+        }
+    }
+}
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration_cast< duration<double> >(steady_clock::now().time_since_epoch()).count();
+}
+
+int main (int argc, char** argv)
+{
+    /* Number of frames to mix per block. */
+    size_t frameCount = 1024;
+
+    /* Number of blocks to mix per run. */
+    size_t blockCount = 20000;
+
+    switch (argc) {
+        case 3: blockCount = atoi(argv[2]);
+        case 2: frameCount = atoi(argv[1]);
+        case 1: break;
+        default:
+                printf("usage: bench_kernels [FRAME_RATE [BLOCKS]]\n");
+                return 0;
+    }
+
+    Afloat   const gain[2] = { 0.5f, 0.75f };
+    Afloat   const peak = 0.9f;
+
+    for (size_t channels = 1; channels <= 2; channels++)
+    {
+        AiBuffer src(frameCount * channels);
+        for (size_t i = 0; i < src.size(); i++)
+            src[i] = static_cast<Aint>((rand() % 65536) - 32768);
+
+        AfBuffer expect(frameCount * 2, 0.0f);
+        AfBuffer result(frameCount * 2, 0.0f);
+
+        /* Reference loop */
+        double t = now();
+        for (size_t b = 0; b < blockCount; b++)
+            reference_mix(expect.data(), src, frameCount, channels, gain, peak);
+        double const tRef = now() - t;
+
+        printf("%s %-8s %8.3f ns/frame\n", channels == 1 ? "mono  " : "stereo", "loop",
+                tRef * 1e9 / (frameCount * blockCount));
+
+        /* Kernels on each supported ISA */
+        for (uint8_t i = 0; i <= static_cast<uint8_t>(Kernel::detect_isa()); i++)
+        {
+            Kernel::Isa const isa = static_cast<Kernel::Isa>(i);
+            Kernel::select_isa(isa);
+
+            std::fill(result.begin(), result.end(), 0.0f);
+
+            t = now();
+            for (size_t b = 0; b < blockCount; b++) {
+                if (channels == 2)
+                    Kernel::mix_i16_stereo(result.data(), src.data(), frameCount, gain[0] * peak, gain[1] * peak);
+                else
+                    Kernel::mix_i16_mono  (result.data(), src.data(), frameCount, gain[0] * peak, gain[1] * peak);
+            }
+            double const tIsa = now() - t;
+
+            /* Largest error of a single block against the reference loop */
+            std::fill(expect.begin(), expect.end(), 0.0f);
+            std::fill(result.begin(), result.end(), 0.0f);
+            reference_mix(expect.data(), src, frameCount, channels, gain, peak);
+            if (channels == 2)
+                Kernel::mix_i16_stereo(result.data(), src.data(), frameCount, gain[0] * peak, gain[1] * peak);
+            else
+                Kernel::mix_i16_mono  (result.data(), src.data(), frameCount, gain[0] * peak, gain[1] * peak);
+
+            double err = 0.0;
+            for (size_t j = 0; j < result.size(); j++)
+                err = std::max(err, std::fabs((double)result[j] - expect[j]));
+
+            printf("%s %-8s %8.3f ns/frame  x%.2f  err %.2e\n", channels == 1 ? "mono  " : "stereo",
+                    Kernel::isa_name(isa), tIsa * 1e9 / (frameCount * blockCount), tRef / tIsa, err);
+        }
+
+        Kernel::select_isa(Kernel::detect_isa());
+    }
+
+    return 0;
+}
@@ -0,0 +1,520 @@
+#include "../source/Adpcm.hpp"
+#include "../source/Frame.hpp"
+#include "../source/Kernels.hpp"
+#include "../source/Planar.hpp"
+#include "../source/Sources/Sampler.hpp"
+#include "../source/Sources/Track.hpp"
+#include "../source/Filters/3BEQ.hpp"
+#include "../source/Filters/IIR.hpp"
+#include "../source/Filters/Maximizer.hpp"
+#include "../source/Filters/Metering.hpp"
+#include "../source/Filters/Mixer.hpp"
+#include "../source/soxr-0.1.1/src/soxr.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace awe;
+
+/* Output sampling rate of every case. */
+static unsigned long const sampleRate = 48000;
+
+/* Number of frames to render per block. */
+static size_t frameCount = 1024;
+
+/* Minimum time to spend on each case, in seconds. */
+static double minTime = 0.5;
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration_cast< duration<double> >(steady_clock::now().time_since_epoch()).count();
+}
+
+/* Stereo white noise in the 16-bit range. */
+static std::shared_ptr<AiBuffer> make_noise(size_t frames)
+{
+    auto buffer = std::make_shared<AiBuffer>(frames * 2);
+    for (Aint &v : *buffer)
+        v = static_cast<Aint>((rand() % 65536) - 32768);
+    return buffer;
+}
+
+/* Source looping over a block of stereo audio with the same mixing kernels
+ * as Sampler at equal rates, so that track cases never run out of input. */
+class LoopSource : public Asource
+{
+private:
+    std::shared_ptr<AiBuffer> mData;
+    size_t                    mRead;
+    Afloat                    mGain[MAX_CHANNELS];
+
+public:
+    LoopSource(std::shared_ptr<AiBuffer> data, size_t offset)
+        : mData(data), mRead(offset % (data->size() / 2))
+    {
+        Kernel::spread_gain(mGain, MAX_CHANNELS, 0.01f, 0.01f);
+    }
+
+    void drop() override { }
+    void make_active(void*) override { }
+    bool is_active() const override { return true; }
+
+    void render(AfBuffer &buffer, const ArenderConfig &config) override
+    {
+        size_t const size = mData->size() / 2;
+        size_t done = 0;
+
+        while (done < config.frameCount) {
+            size_t const frames = std::min<size_t>(config.frameCount - done, size - mRead);
+            Kernel::mix_i16(buffer.data() + (config.frameOffset + done) * config.channels, config.channels,
+                    mData->data() + mRead * 2, 2, frames, mGain);
+            mRead = (mRead + frames) % size;
+            done += frames;
+        }
+    }
+};
+
+/* Looping input of a bare resampler. */
+struct LoopInput
+{
+    const Aint* data;
+    size_t      size;
+    size_t      read;
+
+    static size_t input_fn(void* ptr, const void** buffer, size_t frames)
+    {
+        LoopInput* const in = static_cast<LoopInput*>(ptr);
+        frames  = std::min(frames, in->size - in->read);
+        *buffer = in->data + in->read * 2;
+        in->read = (in->read + frames) % in->size;
+        return frames;
+    }
+};
+
+struct Result
+{
+    std::string name;
+    size_t      frames;
+    double      seconds;
+};
+
+static std::vector<Result> results;
+
+/* Runs `block` until at least `minTime` seconds have passed. Each call
+ * to `block` processes `frameCount` frames. */
+static void run(const std::string &name, const std::function<void()> &block)
+{
+    for (int i = 0; i < 4; i++)
+        block(); // Warm up
+
+    size_t blocks = 0;
+    double const t = now();
+    double elapsed = 0.0;
+
+    do {
+        for (int i = 0; i < 16; i++)
+            block();
+        blocks += 16;
+        elapsed = now() - t;
+    } while (elapsed < minTime);
+
+    Result const r = { name, blocks * frameCount, elapsed };
+    results.push_back(r);
+
+    fprintf(stderr, "%-28s %10.3f ns/frame  x%.1f realtime\n", name.c_str(),
+            elapsed * 1e9 / r.frames, r.frames / (elapsed * sampleRate));
+}
+
+/* Per-frame gain through the generic std::array operator, through the
+ * same-shape Aframe operator, and through the block-wise operation. */
+template< Achan Channels >
+static void run_frame_gain(AfBuffer &buffer)
+{
+    using Frame = Aframe<Afloat, Channels>;
+
+    Frame gain;
+    for (Achan c = 0; c < Channels; c++)
+        gain[c] = (c % 2) ? -1.0f : 1.0f; // Samples neither decay nor grow
+
+    std::string const shape = "_f32x" + std::to_string(Channels);
+    size_t const frames = buffer.size() / Channels;
+
+    run("frame/generic" + shape, [&] {
+        for (size_t i = 0; i < frames; i++) {
+            Frame frame = Frame::from_buffer(buffer, i);
+            frame *= gain.data;
+            frame.to_buffer(buffer, i);
+        }
+    });
+    run("frame/specialized" + shape, [&] {
+        for (size_t i = 0; i < frames; i++) {
+            Frame frame = Frame::from_buffer(buffer, i);
+            frame *= gain;
+            frame.to_buffer(buffer, i);
+        }
+    });
+    run("frame/block" + shape, [&] {
+        apply_gain(buffer, gain);
+    });
+}
+
+int main (int argc, char** argv)
+{
+    /* Process arguments */
+    switch (argc) {
+        case 3: minTime    = atof(argv[2]);
+        case 2: frameCount = atoi(argv[1]);
+        case 1: break;
+        default:
+                printf("usage: bench_suite [FRAME_RATE [SECONDS]]\n");
+                printf("FRAME_RATE  \t number of frames to render per block\n");
+                printf("SECONDS     \t minimum time to spend on each case\n");
+                return 0;
+    }
+
+    frameCount = (frameCount < 128) ? 128 : frameCount; /* Minimum of 128 frames per block */
+
+    /* Ten seconds of input for every case */
+    std::shared_ptr<AiBuffer> noise = make_noise(sampleRate * 10);
+
+    /* One block of the same noise for the filters */
+    AfBuffer input(frameCount * 2);
+    for (size_t i = 0; i < input.size(); i++)
+        input[i] = to_Afloat(noise->at(i));
+
+    AfBuffer buffer(frameCount * 2, 0.0f);
+    ArenderConfig const config(sampleRate, frameCount);
+
+    /*- Track mixing -*/
+    for (size_t voices : { 1, 16, 256 })
+    {
+        Source::Track track(sampleRate, frameCount, "bench");
+        for (size_t i = 0; i < voices; i++)
+            track.attach_source(std::make_shared<LoopSource>(noise, i * 997));
+
+        run("track/voices_" + std::to_string(voices), [&] {
+            std::fill(buffer.begin(), buffer.end(), 0.0f);
+            track.render(buffer, config);
+        });
+    }
+
+    /*- Multichannel mixing kernels and tracks -*/
+    {
+        /* Enough interleaved noise for the widest layout */
+        std::shared_ptr<AiBuffer> wide = make_noise(frameCount * 4);
+        AfBuffer                  out(frameCount * 8, 0.0f);
+        Afloat                    gain[MAX_CHANNELS];
+        Kernel::spread_gain(gain, MAX_CHANNELS, 0.5f, 0.5f);
+
+        struct { Achan src, dst; } const layouts[] = {
+            { 1, 2 }, { 2, 2 }, { 1, 1 }, { 6, 6 }, { 8, 8 }, { 2, 6 }, { 6, 2 }, { 2, 1 }
+        };
+
+        for (const auto &l : layouts)
+        {
+            run("mix/" + std::to_string(l.src) + "_to_" + std::to_string(l.dst), [&] {
+                Kernel::mix_i16(out.data(), l.dst, wide->data(), l.src, frameCount, gain);
+            });
+        }
+
+        for (Achan channels : { 6, 8 })
+        {
+            Source::Track track(sampleRate, frameCount, "bench", 0, 32, channels);
+            for (size_t i = 0; i < 16; i++)
+                track.attach_source(std::make_shared<LoopSource>(noise, i * 997));
+
+            ArenderConfig const wideConfig(sampleRate, frameCount, 0, ArenderConfig::Quality::DEFAULT, channels);
+
+            run("track/channels_" + std::to_string(channels), [&] {
+                std::fill(out.begin(), out.end(), 0.0f);
+                track.render(out, wideConfig);
+            });
+        }
+    }
+
+    /*- Sampler at equal and different rates -*/
+    /* A longer sample, as samplers are rewound by recreating them */
+    std::shared_ptr<AiBuffer> longNoise = make_noise(sampleRate * 60);
+
+    /* The same noise stored as floating point */
+    std::shared_ptr<AfBuffer> longFloatNoise = std::make_shared<AfBuffer>(longNoise->size());
+    for (size_t i = 0; i < longNoise->size(); i++)
+        (*longFloatNoise)[i] = to_Afloat((*longNoise)[i]);
+
+    for (unsigned long rate : { 48000UL, 44100UL })
+    {
+        std::shared_ptr<Asample> const samples[] = {
+            std::make_shared<Asample>(longNoise, 2, 1.0f, rate),
+            std::make_shared<Asample>(longFloatNoise, 2, rate),
+            std::make_shared<Asample>(longNoise, 2, 1.0f, rate)
+        };
+        samples[2]->compress();
+
+        for (const std::shared_ptr<Asample> &sample : samples)
+        {
+            auto sampler = std::make_shared<Source::Sampler>(sample, sampleRate);
+            sampler->configure(config);
+
+            std::string const format =
+                sample->getFormat() == Asample::Format::FLOAT32 ? "_f32"   :
+                sample->getFormat() == Asample::Format::ADPCM   ? "_adpcm" : "";
+
+            run("sampler/" + std::to_string(rate) + "_" + std::to_string(sampleRate) + format, [&] {
+                if (sampler->is_active() == false)
+                    sampler->make_active(nullptr);
+                std::fill(buffer.begin(), buffer.end(), 0.0f);
+                sampler->render(buffer, config);
+            });
+        }
+    }
+
+    /*- Sampler looping a short stretch of a sample -*/
+    {
+        std::shared_ptr<Asample> const sample = std::make_shared<Asample>(longNoise, 2, 1.0f, 44100);
+
+        struct { const char* name; Loop::Mode mode; } const loops[] = {
+            { "repeat", Loop::Mode::REPEAT }, { "pingpong", Loop::Mode::ALTERNATING }
+        };
+
+        for (const auto &l : loops)
+        {
+            auto sampler = std::make_shared<Source::Sampler>(sample, sampleRate);
+            sampler->configure(config);
+            sampler->set_loop(4410, 4410 + 2205, l.mode);
+
+            run(std::string("sampler/44100_") + std::to_string(sampleRate) + "_" + l.name, [&] {
+                std::fill(buffer.begin(), buffer.end(), 0.0f);
+                sampler->render(buffer, config);
+            });
+        }
+    }
+
+    /*- Sampler on the variable-rate resampler, at a steady and a bending speed -*/
+    {
+        std::shared_ptr<Asample> const sample = std::make_shared<Asample>(longNoise, 2, 1.0f, 44100);
+
+        for (bool bend : { false, true })
+        {
+            auto   sampler = std::make_shared<Source::Sampler>(sample, sampleRate, Asfloatf({ 1.0f, 1.0f }), frameCount, 2.0);
+            size_t block   = 0;
+
+            sampler->configure(config);
+            sampler->set_loop(0, sample->getFrameCount());
+
+            run(std::string("sampler/44100_") + std::to_string(sampleRate) + (bend ? "_vr_bend" : "_vr"), [&] {
+                if (bend)
+                    sampler->set_speed(1.0 + 0.06 * std::sin(0.1 * block++));
+
+                std::fill(buffer.begin(), buffer.end(), 0.0f);
+                sampler->render(buffer, config);
+            });
+        }
+    }
+
+    /*- Resampler at each quality, set up like Sampler's -*/
+    struct { const char* name; unsigned long recipe; } const qualities[] = {
+        { "qq" , SOXR_QQ  }, { "lq", SOXR_LQ }, { "mq", SOXR_MQ },
+        { "hq" , SOXR_HQ  }, { "vhq", SOXR_VHQ }
+    };
+
+    for (const auto &q : qualities)
+    {
+        LoopInput in = { noise->data(), noise->size() / 2, 0 };
+
+        soxr_error_t              error  = nullptr;
+        soxr_io_spec_t      const soxIOs = soxr_io_spec(SOXR_INT16_I, SOXR_FLOAT32_I);
+        soxr_quality_spec_t const soxQs  = soxr_quality_spec(q.recipe, 0);
+        soxr_runtime_spec_t const soxRTs = soxr_runtime_spec(Source::SoXR_threads);
+
+        soxr_t soxr = soxr_create(44100.0, static_cast<double>(sampleRate), 2, &error, &soxIOs, &soxQs, &soxRTs);
+        if (error == nullptr)
+            error = soxr_set_input_fn(soxr, (soxr_input_fn_t) LoopInput::input_fn, &in, IO_BUFFER_SIZE);
+
+        if (error) {
+            fprintf(stderr, "libawe [error] soxr %s: %s\n", q.name, error);
+            soxr_delete(soxr);
+            continue;
+        }
+
+        run(std::string("soxr/44100_48000/") + q.name, [&] {
+            soxr_output(soxr, buffer.data(), frameCount);
+        });
+
+        soxr_delete(soxr);
+    }
+
+    /*- Filters; the input is restored before every block -*/
+    run("buffer/copy", [&] {
+        std::copy(input.begin(), input.end(), buffer.begin());
+    });
+
+    {
+        Filter::TBEQ<2> filter(sampleRate);
+        run("filter/tbeq", [&] {
+            std::copy(input.begin(), input.end(), buffer.begin());
+            filter.filter_buffer(buffer);
+        });
+    }
+    {
+        Filter::Maximizer<2> filter(sampleRate);
+        run("filter/maximizer", [&] {
+            std::copy(input.begin(), input.end(), buffer.begin());
+            filter.filter_buffer(buffer);
+        });
+    }
+    {
+        Filter::AscMetering filter(sampleRate, 0.5f);
+        run("filter/metering", [&] {
+            std::copy(input.begin(), input.end(), buffer.begin());
+            filter.filter_buffer(buffer);
+        });
+    }
+    {
+        Filter::AscMixer<2> filter(0.8f, 0.25f);
+        run("filter/mixer", [&] {
+            std::copy(input.begin(), input.end(), buffer.begin());
+            filter.filter_buffer(buffer);
+        });
+    }
+    {
+        Filter::IIR::IIR<2> filter(Filter::IIR::newLPF(sampleRate, 1000.0));
+        run("filter/iir_lpf", [&] {
+            std::copy(input.begin(), input.end(), buffer.begin());
+            filter.process(buffer);
+        });
+    }
+
+    /*- Planar filters; the planar input is restored before every block -*/
+    AplanarBuffer planarInput(2, frameCount);
+    AplanarBuffer planar(2, frameCount);
+    deinterleave(input.data(), planarInput.view());
+
+    auto const restore = [&] {
+        std::copy(planarInput.channel(0), planarInput.channel(0) + planar.getStride() * 2, planar.channel(0));
+    };
+
+    run("planar/copy", restore);
+
+    {
+        Filter::TBEQ<2> filter(sampleRate);
+        run("planar/tbeq", [&] {
+            restore();
+            filter.filter_planar(planar.view());
+        });
+    }
+    {
+        Filter::AscMetering filter(sampleRate, 0.5f);
+        run("planar/metering", [&] {
+            restore();
+            filter.filter_planar(planar.view());
+        });
+    }
+    {
+        Filter::AscMixer<2> filter(0.8f, 0.25f);
+        run("planar/mixer", [&] {
+            restore();
+            filter.filter_planar(planar.view());
+        });
+    }
+    {
+        Filter::IIR::IIR<2> filter(Filter::IIR::newLPF(sampleRate, 1000.0));
+        run("planar/iir_lpf", [&] {
+            restore();
+            filter.process(planar.view());
+        });
+    }
+
+    /*- Frame arithmetic; each buffer holds one block of frames -*/
+    {
+        AfBuffer frames(frameCount * 8, 0.5f);
+        AfBuffer frames2(frames.begin(), frames.begin() + frameCount * 2);
+        AfBuffer frames4(frames.begin(), frames.begin() + frameCount * 4);
+
+        run_frame_gain<2>(frames2);
+        run_frame_gain<4>(frames4);
+        run_frame_gain<8>(frames);
+    }
+
+    /*- Sample format conversion -*/
+    {
+        AiBuffer ibuffer(noise->begin(), noise->begin() + frameCount * 2);
+
+        run("convert/i16_to_f32", [&] {
+            for (size_t i = 0; i < buffer.size(); i++)
+                buffer[i] = to_Afloat(ibuffer[i]);
+        });
+        run("convert/f32_to_i16", [&] {
+            for (size_t i = 0; i < buffer.size(); i++)
+                ibuffer[i] = to_Aint(buffer[i]);
+        });
+        run("convert/deinterleave", [&] {
+            deinterleave(input.data(), planar.view());
+        });
+        run("convert/interleave", [&] {
+            interleave(planar.view(), buffer.data());
+        });
+    }
+
+    /*- Compressed sample storage against plain PCM -*/
+    {
+        AadpcmBuffer const adpcm(noise->data(), noise->size() / 2, 2);
+        AadpcmReader       reader;
+        AiBuffer           decoded(adpcm.getBlockFrames() * 2);
+        size_t             frame = 0;
+
+        reader.reset(&adpcm);
+
+        fprintf(stderr, "%-28s %10.2f x smaller than PCM\n", "decode/adpcm",
+                static_cast<double>(noise->size() * sizeof(Aint)) / adpcm.size());
+
+        /* Each case reads the next frameCount frames, wrapping around */
+        run("decode/adpcm", [&] {
+            for (size_t done = 0; done < frameCount; ) {
+                size_t const block = frame / adpcm.getBlockFrames();
+                done += adpcm.decode(block, decoded.data());
+                frame = (block + 1) * adpcm.getBlockFrames() % adpcm.getFrameCount();
+            }
+        });
+        run("decode/pcm_mix", [&] {
+            for (size_t done = 0; done < frameCount; ) {
+                size_t const n = std::min(frameCount - done, adpcm.getFrameCount() - frame);
+                Kernel::mix_i16_stereo(buffer.data() + done * 2, noise->data() + frame * 2, n, 0.5f, -0.5f);
+                frame = (frame + n) % adpcm.getFrameCount();
+                done += n;
+            }
+        });
+        run("decode/adpcm_mix", [&] {
+            for (size_t done = 0; done < frameCount; ) {
+                size_t n = std::min(frameCount - done, adpcm.getFrameCount() - frame);
+                const Aint* const src = reader.fetch(frame, n);
+                Kernel::mix_i16_stereo(buffer.data() + done * 2, src, n, 0.5f, -0.5f);
+                frame = (frame + n) % adpcm.getFrameCount();
+                done += n;
+            }
+        });
+    }
+
+    /*- Report -*/
+    printf("{\n");
+    printf("  \"frames_per_block\": %zu,\n", frameCount);
+    printf("  \"sample_rate\": %lu,\n", sampleRate);
+    printf("  \"isa\": \"%s\",\n", Kernel::isa_name(Kernel::selected_isa()));
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        printf("    { \"name\": \"%s\", \"frames\": %zu, \"seconds\": %.6f, \"ns_per_frame\": %.3f, \"realtime\": %.2f }%s\n",
+                r.name.c_str(), r.frames, r.seconds, r.seconds * 1e9 / r.frames,
+                r.frames / (r.seconds * sampleRate), i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+
+    return 0;
+}
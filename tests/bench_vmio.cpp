@@ -0,0 +1,122 @@
+#include "../source/awesndfile.hpp"
+#include "../source/Sample.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace awe;
+
+/* Virtual I/O reader as it was written before the bulk copy. */
+static sf_count_t reference_read(void* ptr, sf_count_t count, void* user_data)
+{
+    awe_sf_vmio_data* io = (awe_sf_vmio_data*)user_data;
+    sf_count_t realcount = 0;
+    char* sptr = (char*)ptr;
+
+    for (sf_count_t i = 0; i < count; i++) {
+        if (io->curr < io->size) {
+            sptr[i] = io->mptr[io->curr];
+            io->curr++;
+            realcount++;
+        }
+    }
+
+    return realcount;
+}
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration_cast< duration<double> >(steady_clock::now().time_since_epoch()).count();
+}
+
+static void put_le(std::vector<char> &blob, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        blob.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+}
+
+/* Builds a 16-bit stereo PCM WAV file image of about `bytes` bytes. */
+static std::vector<char> make_wav(size_t bytes)
+{
+    uint32_t const data = static_cast<uint32_t>(bytes & ~size_t(3));
+
+    std::vector<char> blob;
+    blob.reserve(44 + data);
+
+    blob.insert(blob.end(), "RIFF", "RIFF" + 4); put_le(blob, 36 + data, 4);
+    blob.insert(blob.end(), "WAVE", "WAVE" + 4);
+    blob.insert(blob.end(), "fmt ", "fmt " + 4); put_le(blob, 16, 4);
+    put_le(blob, 1, 2);             // PCM
+    put_le(blob, 2, 2);             // Channels
+    put_le(blob, 48000, 4);         // Sampling rate
+    put_le(blob, 48000 * 4, 4);     // Byte rate
+    put_le(blob, 4, 2);             // Block align
+    put_le(blob, 16, 2);            // Bits per sample
+    blob.insert(blob.end(), "data", "data" + 4); put_le(blob, data, 4);
+
+    for (uint32_t i = 0; i < data / 2; i++)
+        put_le(blob, static_cast<uint16_t>((i * 37) & 0xFFFF), 2);
+
+    return blob;
+}
+
+/* Reads the whole blob through a virtual I/O read function. */
+static double time_reader(sf_vio_read reader, std::vector<char> &blob, size_t chunk)
+{
+    std::vector<char> out(chunk);
+    awe_sf_vmio_data io = { 0, static_cast<sf_count_t>(blob.size()), blob.data() };
+
+    double const t = now();
+    while (reader(out.data(), chunk, &io) > 0);
+    return now() - t;
+}
+
+int main (int argc, char** argv)
+{
+    std::vector<char> blob;
+
+    /* Load an audio file into memory, or build a 100 MB WAV file image. */
+    if (argc > 1) {
+        FILE* f = fopen(argv[1], "rb");
+        if (f == nullptr) {
+            printf("usage: bench_vmio [FILE_PATH]\n");
+            printf("FILE_PATH \t audio file to load into memory (default: 100 MB generated WAV)\n");
+            return 0;
+        }
+
+        fseek(f, 0, SEEK_END);
+        blob.resize(ftell(f));
+        fseek(f, 0, SEEK_SET);
+        blob.resize(fread(blob.data(), 1, blob.size(), f));
+        fclose(f);
+    } else {
+        blob = make_wav(100 << 20);
+    }
+
+    double const mb = blob.size() / 1048576.0;
+    printf("blob   %8.1f MB\n", mb);
+
+    /* Raw virtual I/O throughput */
+    for (size_t chunk : { 4096, 65536 }) {
+        double const tRef = time_reader(reference_read  , blob, chunk);
+        double const tNew = time_reader(awe_sf_vmio_read, blob, chunk);
+
+        printf("read   %6zu B  loop %8.1f MB/s  memcpy %8.1f MB/s  x%.1f\n",
+                chunk, mb / tRef, mb / tNew, tRef / tNew);
+    }
+
+    /* Full sample load from memory */
+    double const t = now();
+    Asample sample(blob.data(), blob.size(), "bench");
+    double const tLoad = now() - t;
+
+    if (sample.has_data())
+        printf("load   %zu frames in %.3f s (%.1f MB/s)\n", sample.getFrameCount(), tLoad, mb / tLoad);
+    else
+        printf("load   failed\n");
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "../source/SampleLoader.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace awe;
+
+int main (int argc, char** argv)
+{
+    if (argc < 3) {
+        printf("usage: load_bank WORKERS FILE_PATH...\n");
+        printf("WORKERS   \t number of loader threads (0 to load on this thread)\n");
+        printf("FILE_PATH \t sound files to load as one bank\n");
+        return 0;
+    }
+
+    auto pool   = std::make_shared<AThreadPool>(atoi(argv[1]));
+    auto loader = std::make_shared<AsampleLoader>(pool);
+
+    std::vector<std::string> files(argv + 2, argv + argc);
+
+    auto const start = std::chrono::steady_clock::now();
+    auto const since = [&start] {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    /*- Request the whole bank; this returns immediately -*/
+    auto handles = loader->load(files);
+    printf("Requested %zu samples in %.3f s\n", handles.size(), since());
+
+    /*- The first sample can be played as soon as it is ready -*/
+    handles.front().wait();
+    printf("First sample ready after %.3f s\n", since());
+
+    /*- Wait for the rest of the bank -*/
+    size_t frames = 0, failed = 0;
+    for (auto &handle : handles) {
+        auto sample = handle.get();
+        if (sample->has_data())
+            frames += sample->getFrameCount();
+        else
+            failed += 1;
+    }
+
+    printf("Loaded %zu samples (%zu failed, %zu frames) in %.3f s on %zu workers\n",
+            handles.size() - failed, failed, frames, since(), pool->size());
+
+    return 0;
+}
@@ -1,9 +1,11 @@
 #include "../source/Engine.hpp"
 #include "../source/Filters/Metering.hpp"
 #include "../source/Sources/Sampler.hpp"
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <thread>
 #include <memory>
 
@@ -20,11 +22,17 @@ int main (int argc, char** argv)
     unsigned frameCount = 2048;
 #endif
 
-    /* Playing speed, done using linear resampling */
+    /* Playing speed, done by the variable-rate resampler */
     float playSpeed = 1.0f;
 
+    /* Render in the device callback instead of queueing ahead */
+    AEngine::Mode mode = AEngine::Mode::QUEUE;
+
     /* Process arguments */
     switch (argc) {
+        case 5: argc--;
+                if (strcmp(argv[4], "pull") == 0)
+                    mode = AEngine::Mode::PULL;
         case 4: argc--;
                 playSpeed  = atof(argv[3]);
         case 3: argc--;
@@ -33,9 +41,10 @@ int main (int argc, char** argv)
                 //  char* file = argv[1];
                 break;
         default:
-                printf("usage: file_test FILE_PATH [FRAME_RATE [PLAY_PITCH]]\n");
+                printf("usage: file_test FILE_PATH [FRAME_RATE [PLAY_PITCH [MODE]]]\n");
                 printf("FRAME_RATE \t frame rate of output device\n");
                 printf("PLAY_PITCH \t output render pitch (Note: Experimental)\n");
+                printf("MODE       \t 'queue' (default) or 'pull' to render in the device callback\n");
                 return 0;
                 break;
     }
@@ -43,28 +52,42 @@ int main (int argc, char** argv)
     frameCount = (frameCount < 128) ? 128 : frameCount; /* Minimum of 128 frames per update */
 
     /*- Start engine -*/
-    auto engine = std::make_shared<AEngine>(48000, frameCount);
+    auto engine = std::make_shared<AEngine>(48000, frameCount, APortAudio::HostAPIType::Default, mode);
 
     /*- Open file -*/
-    auto sample = std::make_shared<Asample>(argv[1]);
-    if (!sample->getSource()) {
+    auto sample = Asample::open(argv[1]); /* Memory-mapped if possible */
+    if (!sample->has_data()) {
         fprintf(stderr, "Failed to read file. Exiting... \n");
         return 0;
     }
 
-    auto sampler = std::make_shared<Source::Sampler>(sample, 48000 / playSpeed);
+    auto sampler = std::make_shared<Source::Sampler>(sample, 48000, Asfloatf({ 1.0f, 1.0f }), frameCount, std::max(playSpeed, 1.0f));
+    if (sampler->set_speed(playSpeed) == false) {
+        fprintf(stderr, "Invalid playing speed. Exiting... \n");
+        return 0;
+    }
     auto meter   = std::make_shared<Filter::AscMetering>(48000, 0.0);
 
     // smp->skip(0, true); // skip through silence at the beginning
     engine->getMasterTrack().attach_source(sampler);
-    engine->getMasterTrack().getRack().attach_filter(meter);
+    {
+        /* The rack may already be in use by the device thread in pull mode. */
+        std::lock_guard<std::mutex> lock(engine->getMasterTrack().getMutex());
+        engine->getMasterTrack().getRack().attach_filter(meter);
+    }
 
     /*- Main loop -*/
     while (engine->getMasterTrack().count_active_sources() != 0)
     {
-        if (engine->update() == false) {
+        if (mode == AEngine::Mode::PULL) {
+            /* Rendering happens on the device thread; just poll the meter. */
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000 * frameCount / 48000));
+        } else if (engine->update() == false) {
             std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        } else {
+            continue;
+        }
+
+        {
             /*- Console Visualization -*/
             auto p = meter->getPeak();
             auto r = meter->getAvgRMS();
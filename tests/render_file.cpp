@@ -0,0 +1,82 @@
+#include "../source/OfflineEngine.hpp"
+#include "../source/Profiler.hpp"
+#include "../source/Sources/Sampler.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+using namespace awe;
+
+int main (int argc, char** argv)
+{
+    /* Number of frames to render per block. */
+    unsigned frameCount = 4096;
+
+    /* Output sampling rate. */
+    unsigned sampleRate = 48000;
+
+    /* Chrome trace output path; profiling is off without one. */
+    const char* tracePath = nullptr;
+
+    /* Process arguments */
+    switch (argc) {
+        case 6: argc--;
+                tracePath = argv[5];
+        case 5: argc--;
+                sampleRate = atoi(argv[4]);
+        case 4: argc--;
+                frameCount = atoi(argv[3]);
+        case 3: argc--;
+                break;
+        default:
+                printf("usage: render_file IN_PATH OUT_PATH [FRAME_RATE [SAMPLE_RATE [TRACE_PATH]]]\n");
+                printf("FRAME_RATE  \t number of frames to render per block\n");
+                printf("SAMPLE_RATE \t output sampling rate\n");
+                printf("TRACE_PATH  \t write a Chrome trace of every source and filter call\n");
+                return 0;
+                break;
+    }
+
+    frameCount = (frameCount < 128) ? 128 : frameCount; /* Minimum of 128 frames per block */
+
+    /*- Start engine; no audio device required -*/
+    AOfflineEngine engine(sampleRate, frameCount);
+
+    /*- Open files -*/
+    auto sample = Asample::open(argv[1]); /* Memory-mapped if possible */
+    if (!sample->has_data()) {
+        fprintf(stderr, "Failed to read file. Exiting... \n");
+        return 1;
+    }
+
+    AsndfileWriter output(argv[2], sampleRate, 2, SF_FORMAT_WAV | SF_FORMAT_PCM_16);
+    if (!output.is_open()) {
+        fprintf(stderr, "Failed to open output file. Exiting... \n");
+        return 1;
+    }
+
+    engine.getMasterTrack().attach_source(std::make_shared<Source::Sampler>(sample, sampleRate));
+
+    if (tracePath)
+        Aprofiler::enable();
+
+    /*- Render everything -*/
+    size_t frames = engine.render(output);
+
+    printf ("Rendered %zu frames in %.3f s (%.1fx realtime).\n",
+            frames, engine.getRenderTime(), engine.getRealtimeFactor());
+
+    if (tracePath) {
+        Aprofiler::disable();
+
+        for (const Aprofiler::Entry &e : Aprofiler::snapshot())
+            printf ("[%s] %s: %llu calls, %llu frames, %.3f ms total, %.3f ms peak\n",
+                    e.track.c_str(), e.name.c_str(),
+                    (unsigned long long) e.calls, (unsigned long long) e.frames,
+                    e.seconds * 1e3, e.peak * 1e3);
+
+        Aprofiler::write_trace(tracePath);
+    }
+
+    return 0;
+}